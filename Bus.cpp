@@ -1,4 +1,6 @@
 #include "Bus.h"
+#include "SaveState.h"
+#include <algorithm>
 #include <cstring>
 #include <iostream>
 
@@ -11,35 +13,92 @@ Bus::Bus()
     controller_shift[0] = controller_shift[1] = 0;
     controller_strobe = 0;
     prev_controller_strobe = 0;
+    ppu.connectBus(this);
+    rebuildMemoryMap();
 }
 
 void Bus::insertCartridge(const std::shared_ptr<Cartridge> &cartridge)
 {
     this->cartridge = cartridge;
+    if (cartridge->mapper)
+        cartridge->mapper->connectIRQ(&interrupts.pending, Interrupts::MAPPER_IRQ);
+    rebuildMemoryMap();
+    cpu.flushDecodeCache(); // decoded and translated code came from the old PRG
+    stateLayout.clear();
+}
+
+void Bus::rebuildMemoryMap()
+{
+    Mapper *mapper = cartridge ? cartridge->mapper.get() : nullptr;
+    mapVersion = mapper ? mapper->cpuMapVersion() : 0;
+    for (int page = 0; page < 256; page++)
+    {
+        uint16_t first = page << 8;
+        uint16_t last = first | 0xFF;
+        uint32_t lo = 0, hi = 0;
+        bool cartFirst = mapper && mapper->cpuMapRead(first, lo);
+        bool cartLast = mapper && mapper->cpuMapRead(last, hi);
+        readPage[page] = nullptr;
+        writePage[page] = nullptr;
+
+        if (cartFirst && cartLast)
+        {
+            // Direct only if the whole page is one contiguous run of PRG
+            if (hi == lo + 0xFF && hi < cartridge->prgSize)
+                readPage[page] = cartridge->prg + lo;
+        }
+        else if (!cartFirst && !cartLast && page < 0x20)
+        {
+            readPage[page] = &CPUmem[first & 0x07FF];
+            if (!mapper || !(mapper->cpuMapWrite(first, lo) || mapper->cpuMapWrite(last, hi)))
+                writePage[page] = &CPUmem[first & 0x07FF];
+        }
+    }
 }
 
 void Bus::CPUwrite(uint16_t addr, uint8_t data)
 {
+    if (uint8_t *page = writePage[addr >> 8])
+    {
+        page[addr & 0xFF] = data;
+        cpu.ramWritten(addr);
+        return;
+    }
     if (cartridge->CPUwrite(addr, data))
     {
+        // PRG write or mapper register: code or bank mapping may have changed
+        cpu.cartridgeWritten();
+        if (cartridge->mapper->cpuMapVersion() != mapVersion)
+            rebuildMemoryMap();
+        if (cartridge->mapper->ntMapVersion() != ppu.ntMapVersion)
+            ppu.mapNametables();
+        if (cartridge->mapper->dotsUntilIRQ() != Mapper::NO_IRQ)
+        {
+            // The write may have armed or reloaded an IRQ counter
+            syncPPU();
+            nextEvent = std::min(nextEvent, ppuClock + dotsUntilEvent());
+        }
         return;
     }
     else if (addr <= 0x1FFF)
     {
         CPUmem[addr & 0x07FF] = data;
+        cpu.ramWritten(addr);
     }
     else if (addr >= 0x2000 && addr <= 0x3FFF)
     {
+        syncPPU();
         ppu.CPUwrite(addr & 0x0007, data);
         return;
     }
     else if (addr == 0x4014)
     {
+        syncPPU();
         dma.page = data;
         dma.addr = 0x00;
         ppu.oamaddr = 0;
-        dma.transfer = true;
         dma.dummy = true;
+        interrupts.set(Interrupts::DMA);
         return;
     }
     else if (addr == 0x4016)
@@ -62,6 +121,10 @@ void Bus::CPUwrite(uint16_t addr, uint8_t data)
 
 uint8_t Bus::CPUread(uint16_t addr)
 {
+    if (const uint8_t *page = readPage[addr >> 8])
+    {
+        return page[addr & 0xFF];
+    }
     uint8_t data = 0x00;
     if (cartridge->CPUread(addr, data))
     {
@@ -73,6 +136,7 @@ uint8_t Bus::CPUread(uint16_t addr)
     }
     else if (addr >= 0x2000 && addr <= 0x3FFF)
     {
+        syncPPU();
         data = ppu.CPUread(addr & 0x0007);
     }
     else if (addr == 0x4016 || addr == 0x4017)
@@ -100,6 +164,259 @@ uint16_t Bus::CPUread16(uint16_t addr)
     return LoByte | (HiByte << 8);
 }
 
+void Bus::syncPPU()
+{
+    // On AccurateBus the CPU is part way through an instruction: run the PPU
+    // up to the cycle of the access being made
+    uint64_t target = masterClock;
+    if constexpr (CPU6502::Accuracy::cycleAccurate)
+        target += 3 * cpu.busCycle;
+    while (ppuClock < target)
+    {
+        // Nothing can touch the PPU before target, so a whole visible line
+        // that ends before it can be drawn in one go
+        if (target - ppuClock >= 341 && ppu.tickLine())
+        {
+            ppuClock += 341;
+            continue;
+        }
+        ppu.tick();
+        ppuClock++;
+    }
+}
+
+uint32_t Bus::dotsUntilEvent() const
+{
+    uint32_t dots = ppu.dotsUntilEvent();
+    if (cartridge && cartridge->mapper)
+        dots = std::min(dots, cartridge->mapper->dotsUntilIRQ());
+    return dots;
+}
+
+void Bus::runDMA()
+{
+    // One dummy cycle, plus one more to line up if we start on an even cycle
+    masterClock += ((masterClock / 3) % 2 == 1) ? 3 : 6;
+
+    for (int i = 0; i < 256; i++)
+    {
+        dma.data = CPUread((dma.page << 8) | i);
+        masterClock += 3;
+        syncPPU();
+        ppu.CPUwrite(0x2004, dma.data);
+        masterClock += 3;
+    }
+    dma.addr = 0x00;
+    dma.dummy = true;
+    interrupts.clear(Interrupts::DMA);
+}
+
+void Bus::postNMI()
+{
+    // Called from PPU::tick inside syncPPU, so ppuClock is the dot being run
+    interrupts.nmiAt = ppuClock;
+    interrupts.set(Interrupts::NMI);
+}
+
+void Bus::step()
+{
+    if (interrupts.pending & Interrupts::DMA)
+    {
+        runDMA();
+    }
+    else if (cpu.useRecompiler && !cpu.trace && !(interrupts.pending & ~Interrupts::IRQ) && !cpu.irqDue() &&
+             masterClock < nextEvent)
+    {
+        // Translated blocks may run several instructions, but never past the
+        // next PPU event, so NMI is still seen at the same boundary. A masked
+        // IRQ line doesn't stop them: they leave as soon as I is cleared.
+        uint32_t budget = (nextEvent - masterClock + 2) / 3;
+        uint32_t spent = cpu.runCompiled(budget);
+        masterClock += 3 * (spent ? spent : cpu.step());
+    }
+    else
+    {
+        // Bus accesses inside the instruction sync the PPU to its first cycle,
+        // the same point the old lockstep loop had reached.
+        masterClock += 3 * cpu.step();
+    }
+
+    if (cpu.idleLoopCycles)
+    {
+        skipIdleLoop();
+    }
+
+    if (masterClock >= nextEvent)
+    {
+        syncPPU();
+        lastEvent = nextEvent;
+        nextEvent = ppuClock + dotsUntilEvent();
+    }
+}
+
+void Bus::skipIdleLoop()
+{
+    uint64_t iteration = cpu.idleLoopCycles;
+    cpu.idleLoopCycles = 0;
+    if (interrupts.pending || masterClock + 3 * iteration > nextEvent)
+        return;
+
+    // A $2002 poll is only frozen if PPUSTATUS held still over both matching
+    // passes: vblank moves at predicted events, sprite 0 hit and overflow on
+    // rendered lines, so outside vblank rendering must be off.
+    if (cpu.idleReadsPPU)
+    {
+        if (masterClock < lastEvent + 6 * iteration)
+            return;
+        syncPPU();
+        bool rendering = ppu.ppumask.showBG || ppu.ppumask.showSprites;
+        bool vblank = ppu.scanline_cycle >= 241 && ppu.scanline_cycle <= 260;
+        if (rendering && !vblank)
+            return;
+    }
+
+    // Every skipped pass would leave the machine exactly as it is now, so
+    // charge whole iterations up to the event and resume at the loop head.
+    uint64_t passes = (nextEvent - masterClock) / (3 * iteration);
+    masterClock += passes * 3 * iteration;
+    cpu.totalcycles += passes * iteration;
+    cpu.idleStart += passes * iteration;
+}
+
+void Bus::saveState(std::vector<uint8_t> &out) const
+{
+    StateWriter w(out);
+
+    w.beginChunk("CPU ");
+    cpu.saveState(w);
+    w.endChunk();
+
+    w.beginChunk("BUS ");
+    w.put(CPUmem);
+    w.put(controller);
+    w.put(controller_shift);
+    w.put(controller_strobe);
+    w.put(prev_controller_strobe);
+    w.put(dma.dummy);
+    w.put(dma.page);
+    w.put(dma.addr);
+    w.put(dma.data);
+    w.put(interrupts.pending);
+    w.put(interrupts.nmiAt);
+    w.put(masterClock);
+    w.put(ppuClock);
+    w.put(nextEvent);
+    w.put(lastEvent);
+    w.endChunk();
+
+    w.beginChunk("PPU ");
+    ppu.saveState(w);
+    w.endChunk();
+
+    if (cartridge && cartridge->mapper)
+    {
+        w.beginChunk("CART");
+        cartridge->saveState(w);
+        w.endChunk();
+
+        w.beginChunk("MAPR");
+        cartridge->mapper->saveState(w);
+        w.endChunk();
+    }
+}
+
+bool Bus::checkState(StateReader &in)
+{
+    // Chunk sizes only depend on the cartridge, so one state of our own
+    // says what every chunk must measure
+    if (stateLayout.empty())
+        saveState(stateLayout);
+    StateReader own(stateLayout.data(), stateLayout.size());
+    static const char tags[][5] = {"CPU ", "BUS ", "PPU ", "CART", "MAPR"};
+    for (const auto &tag : tags)
+    {
+        if (own.open(tag) && (!in.open(tag) || in.remaining() != own.remaining()))
+            return false;
+    }
+
+    in.open("BUS ");
+    in.skip(sizeof(CPUmem) + sizeof(controller) + sizeof(controller_shift) + 2);
+    if (!in.flag()) // dma.dummy
+        return false;
+    in.open("PPU ");
+    if (!ppu.checkState(in))
+        return false;
+    if (cartridge && cartridge->mapper)
+    {
+        in.open("CART");
+        if (!cartridge->checkState(in))
+            return false;
+        in.open("MAPR");
+        if (!cartridge->mapper->checkState(in))
+            return false;
+    }
+    return in.ok();
+}
+
+bool Bus::loadState(const uint8_t *data, size_t size)
+{
+    StateReader in(data, size);
+    bool cart = cartridge && cartridge->mapper;
+    if (!in.valid() || !checkState(in))
+        return false;
+
+    in.open("CPU ");
+    cpu.loadState(in);
+
+    in.open("BUS ");
+    in.get(CPUmem);
+    in.get(controller);
+    in.get(controller_shift);
+    in.get(controller_strobe);
+    in.get(prev_controller_strobe);
+    in.get(dma.dummy);
+    in.get(dma.page);
+    in.get(dma.addr);
+    in.get(dma.data);
+    in.get(interrupts.pending);
+    in.get(interrupts.nmiAt);
+    in.get(masterClock);
+    in.get(ppuClock);
+    in.get(nextEvent);
+    in.get(lastEvent);
+
+    in.open("PPU ");
+    ppu.loadState(in);
+
+    if (cart)
+    {
+        in.open("CART");
+        cartridge->loadState(in);
+        in.open("MAPR");
+        cartridge->mapper->loadState(in);
+        if (cartridge->mapper->ppuMapVersion() != cartridge->chrMapVersion)
+            cartridge->rebuildPatternMap();
+        ppu.mapNametables(); // mirroring comes from CART as well
+    }
+
+    // The page table, and code decoded or translated from ROM, only go stale
+    // if the load switched a bank
+    if (cart && cartridge->mapper->cpuMapVersion() != mapVersion)
+    {
+        rebuildMemoryMap();
+        cpu.cartridgeWritten();
+    }
+    return in.ok();
+}
+
+void Bus::runFrame()
+{
+    while (!ppu.frame_complete)
+    {
+        step();
+    }
+}
+
 uint8_t Bus::PPUread(uint16_t addr)
 {
     return ppu.PPUread(addr);
@@ -2,6 +2,7 @@
 #define BUS_H
 
 #include <cstdint>
+#include <vector>
 #include "CPU6502.h"
 #include "PPU2C02.h"
 #include "CARTRIDGE.h"
@@ -18,7 +19,6 @@ public:
     struct OAM_DMA
     {
         bool dummy = true; // alignment/dummy phase
-        bool transfer = false;
         uint8_t page = 0x00; // high byte of source address
         uint8_t addr = 0x00; // low byte (0..255)
         uint8_t data = 0x00; // buffered read byte
@@ -28,6 +28,27 @@ public:
     uint8_t controller_strobe = 0;
     uint8_t prev_controller_strobe = 0;
     OAM_DMA dma;
+
+    // Interrupt and stall lines. The PPU, mappers, the APU and OAM DMA set and
+    // clear bits here; the CPU tests the whole word once per instruction
+    // boundary and only looks at individual lines when something is pending.
+    struct Interrupts
+    {
+        enum Line : uint8_t
+        {
+            NMI = 0x01,        // edge, cleared when the CPU takes it
+            MAPPER_IRQ = 0x02, // level, held until the mapper acknowledges
+            APU_IRQ = 0x04,    // level, frame counter / DMC
+            DMA = 0x08,        // OAM DMA stall, cleared when the copy ends
+            IRQ = MAPPER_IRQ | APU_IRQ,
+        };
+        uint8_t pending = 0;
+        uint64_t nmiAt = 0; // PPU dot the NMI edge arrived on
+        void set(uint8_t lines) { pending |= lines; }
+        void clear(uint8_t lines) { pending &= ~lines; }
+    };
+    Interrupts interrupts;
+    void postNMI();
     std::shared_ptr<Cartridge> cartridge;
     uint8_t CPUread(uint16_t addr);
     void CPUwrite(uint16_t addr, uint8_t data);
@@ -36,6 +57,42 @@ public:
     void PPUwrite(uint16_t addr, uint8_t data);
     void insertCartridge(const std::shared_ptr<Cartridge> &cartridge);
     bool stepDMA();
+
+    // CPU memory map, one entry per 256-byte page. A non-null entry points
+    // straight at host memory (internal RAM or a mapped PRG bank); null pages
+    // (I/O, unmapped, mapper registers) go through CPUread/CPUwrite. Rebuilt
+    // on cartridge insert and whenever the mapper reports a bank switch.
+    const uint8_t *readPage[256];
+    uint8_t *writePage[256];
+    uint32_t mapVersion = 0; // Mapper::cpuMapVersion() the table was built from
+    void rebuildMemoryMap();
+
+    // Catch-up scheduler. masterClock counts PPU dots (3 per CPU cycle) and is
+    // advanced by whole CPU instructions. The PPU only runs up to it when the CPU
+    // touches $2000-$3FFF/$4014 or when the next predicted event is due: a PPU
+    // event or a mapper IRQ (Mapper::dotsUntilIRQ).
+    uint64_t masterClock = 0;
+    uint64_t ppuClock = 0;  // dots the PPU has actually run
+    uint64_t nextEvent = 0; // masterClock at which the PPU must be synced
+    uint64_t lastEvent = 0; // the previous value of nextEvent
+    void syncPPU();
+    uint32_t dotsUntilEvent() const; // from ppuClock, PPU or mapper IRQ
+    void runDMA();
+    void skipIdleLoop();
+    void step();     // one CPU instruction, interrupt or OAM DMA
+    void runFrame(); // step until the PPU reports frame_complete
+
+    // Whole-machine save state (format in SaveState.h). saveState reuses the
+    // capacity of out, so repeated snapshots into the same buffer don't
+    // allocate. loadState checks the header, that every chunk is present
+    // with the size this machine writes, and that enum, index and bool fields
+    // are in range before touching the machine; it returns false on a bad or
+    // foreign state.
+    void saveState(std::vector<uint8_t> &out) const;
+    bool loadState(const uint8_t *data, size_t size);
+    bool loadState(const std::vector<uint8_t> &state) { return loadState(state.data(), state.size()); }
+    std::vector<uint8_t> stateLayout; // a state of this machine, for chunk sizes; cleared on insert
+    bool checkState(StateReader &in);
     enum NESButtons
     {
         NES_A = 0x01,
@@ -0,0 +1,25 @@
+#pragma once
+
+// Bus timing policies for CPU6502, picked at build time (SIMPLENES_ACCURATE).
+// FastBus makes every access of an instruction at its first cycle. AccurateBus
+// gives each access its own cycle, adds the dummy reads and the RMW dummy write,
+// and the PPU is synced to that cycle on I/O.
+struct FastBus
+{
+    static constexpr bool cycleAccurate = false;
+};
+
+struct AccurateBus
+{
+    static constexpr bool cycleAccurate = true;
+};
+
+// CPU6502 compiles to different code under each policy, so each build puts it
+// in its own inline namespace. Code compiled with the other setting then names
+// a class the core library doesn't define and fails to link, instead of two
+// definitions of one class being mixed silently.
+#ifdef SIMPLENES_ACCURATE
+#define SIMPLENES_BUS_NAMESPACE accurate_bus
+#else
+#define SIMPLENES_BUS_NAMESPACE fast_bus
+#endif
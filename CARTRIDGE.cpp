@@ -1,9 +1,29 @@
-#include "Cartridge.h"
+#include "CARTRIDGE.h"
 #include "mappers/Mapper000.h"
+#include "SaveState.h"
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 
-Cartridge::Cartridge(const std::string &filename)
+void decodePatternTiles(const uint8_t *chr, size_t tiles, PatternTile *out)
+{
+    for (size_t t = 0; t < tiles; t++, chr += 16, out++)
+    {
+        for (int y = 0; y < 8; y++)
+        {
+            uint8_t lo = chr[y];
+            uint8_t hi = chr[y + 8];
+            for (int x = 0; x < 8; x++)
+            {
+                uint8_t pixel = (((hi >> (7 - x)) & 1) << 1) | ((lo >> (7 - x)) & 1);
+                out->rows[y][x] = pixel;
+                out->flipped[y][7 - x] = pixel;
+            }
+        }
+    }
+}
+
+std::shared_ptr<const RomImage> RomImage::load(const std::string &filename)
 {
     struct sHeader {
         char name[4];
@@ -17,59 +37,146 @@ Cartridge::Cartridge(const std::string &filename)
         char padding[5]; 
     } header;
 
+    auto image = std::make_shared<RomImage>();
 
     std::ifstream ifs(filename, std::ifstream::binary);
-    if (!ifs.is_open()) { std::cerr << "Failed to open ROM\n"; return; }
+    if (!ifs.is_open()) { std::cerr << "Failed to open ROM\n"; return image; }
 
     ifs.read(reinterpret_cast<char*>(&header), 16); 
 
     if (!(header.name[0] == 'N' && header.name[1] == 'E' &&
           header.name[2] == 'S' && header.name[3] == 0x1A)) {
-        std::cerr << "Not a valid iNES file!\n"; return;
+        std::cerr << "Not a valid iNES file!\n"; return image;
     }
 
     if (header.flags6 & 0x04)
         ifs.seekg(512, std::ios_base::cur); 
 
-    uint8_t mapperID = ((header.flags6 >> 4) | ((header.flags7 >> 4) << 4));
+    image->mapperID = ((header.flags6 >> 4) | ((header.flags7 >> 4) << 4));
+    image->prgBanks = header.prg_rom_chunks;
+    image->chrBanks = header.chr_rom_chunks;
 
-    vPRGMemory.resize(header.prg_rom_chunks * 16384);
-    ifs.read(reinterpret_cast<char*>(vPRGMemory.data()), vPRGMemory.size());
+    image->prg.resize(header.prg_rom_chunks * 16384);
+    ifs.read(reinterpret_cast<char*>(image->prg.data()), image->prg.size());
 
-    if (header.chr_rom_chunks == 0)
-        vCHRMemory.resize(8192);
-    else {
-        vCHRMemory.resize(header.chr_rom_chunks * 8192);
-        ifs.read(reinterpret_cast<char*>(vCHRMemory.data()), vCHRMemory.size());
-    }
+    image->chr.resize(header.chr_rom_chunks * 8192);
+    ifs.read(reinterpret_cast<char*>(image->chr.data()), image->chr.size());
+    image->chrTiles.resize(image->chr.size() / 16);
+    decodePatternTiles(image->chr.data(), image->chrTiles.size(), image->chrTiles.data());
 
         if (header.flags6 & 0x08)
     {
-        mirror = MIRROR::FOUR_SCREEN;
+        image->mirror = MIRROR::FOUR_SCREEN;
     }
     else
     {
-        mirror = (header.flags6 & 0x01) ? MIRROR::VERTICAL : MIRROR::HORIZONTAL;
+        image->mirror = (header.flags6 & 0x01) ? MIRROR::VERTICAL : MIRROR::HORIZONTAL;
     }
 
     ifs.close();
 
-    switch (mapperID) {
-        case 0: mapper = std::make_unique<Mapper000>(header.prg_rom_chunks, header.chr_rom_chunks); break;
-        default: std::cerr << "Mapper " << (int)mapperID << " not supported!\n"; return;
-    }
-
-    imageValid = true;
+    image->valid = true;
     std::cout << "Loaded ROM: " << filename
-              << " | Mapper: " << (int)mapperID
+              << " | Mapper: " << (int)image->mapperID
               << " | PRG Banks: " << (int)header.prg_rom_chunks
               << " | CHR Banks: " << (int)header.chr_rom_chunks << "\n";
+    return image;
+}
+
+Cartridge::Cartridge(const std::string &filename) : Cartridge(RomImage::load(filename))
+{
+}
+
+Cartridge::Cartridge(std::shared_ptr<const RomImage> image) : rom(std::move(image))
+{
+    if (!rom || !rom->valid)
+        return;
+
+    mirror = rom->mirror;
+    if (mirror == MIRROR::FOUR_SCREEN)
+        vNametableRAM.resize(2048);
+    prg = rom->prg.data();
+    prgSize = rom->prg.size();
+    chrRAM = rom->chrBanks == 0;
+    if (chrRAM)
+    {
+        vCHRRAM.resize(8192);
+        chr = vCHRRAM.data();
+        chrSize = vCHRRAM.size();
+        ownTiles.resize(chrSize / 16);
+        staleTiles.assign(chrSize / 16, 1);
+        tiles = ownTiles.data();
+    }
+    else
+    {
+        chr = rom->chr.data();
+        chrSize = rom->chr.size();
+        tiles = rom->chrTiles.data();
+        if (rom->chrTiles.size() != chrSize / 16)
+        {
+            ownTiles.resize(chrSize / 16);
+            decodePatternTiles(chr, ownTiles.size(), ownTiles.data());
+            tiles = ownTiles.data();
+        }
+    }
+
+    switch (rom->mapperID) {
+        case 0: mapper = std::make_unique<Mapper000>(rom->prgBanks, rom->chrBanks); break;
+        default: std::cerr << "Mapper " << (int)rom->mapperID << " not supported!\n"; return;
+    }
+    rebuildPatternMap();
+
+    imageValid = true;
+}
+
+void Cartridge::rebuildPatternMap()
+{
+    chrMapVersion = mapper ? mapper->ppuMapVersion() : 0;
+    for (int slot = 0; slot < 8; slot++)
+    {
+        uint32_t mapped_addr;
+        if (mapper && mapper->ppuMapRead(slot * 0x400, mapped_addr) && mapped_addr + 0x400 <= chrSize &&
+            (mapped_addr & 0x03FF) == 0)
+        {
+            chrPage[slot] = chr + mapped_addr;
+            chrTileBase[slot] = mapped_addr / 16;
+        }
+        else
+        {
+            chrPage[slot] = nullptr;
+            chrTileBase[slot] = 0;
+        }
+    }
 }
 
 Cartridge::MIRROR Cartridge::getMirror(){
     return mirror;
 }
 
+void Cartridge::mapNametables(uint8_t *ciram, uint8_t *pages[4])
+{
+    if (mapper && mapper->mapNametables(ciram, pages))
+        return;
+
+    static const uint8_t layouts[4][4] = {
+        {0, 0, 1, 1}, // HORIZONTAL
+        {0, 1, 0, 1}, // VERTICAL
+        {0, 0, 0, 0}, // ONE_SCREEN_LO
+        {1, 1, 1, 1}, // ONE_SCREEN_HI
+    };
+    if (mirror == MIRROR::FOUR_SCREEN && vNametableRAM.size() == 2048)
+    {
+        pages[0] = ciram;
+        pages[1] = ciram + 0x400;
+        pages[2] = vNametableRAM.data();
+        pages[3] = vNametableRAM.data() + 0x400;
+        return;
+    }
+    const uint8_t *layout = layouts[mirror == MIRROR::FOUR_SCREEN ? int(MIRROR::VERTICAL) : int(mirror)];
+    for (int i = 0; i < 4; i++)
+        pages[i] = ciram + layout[i] * 0x400;
+}
+
 bool Cartridge::CPUread(uint16_t addr, uint8_t &data)
 {
     if (!mapper) {
@@ -77,9 +184,9 @@ bool Cartridge::CPUread(uint16_t addr, uint8_t &data)
         return false;
     }
     uint32_t mapped_addr;
-    if (mapper->cpuMapRead(addr, mapped_addr) && mapped_addr < vPRGMemory.size())
+    if (mapper->cpuMapRead(addr, mapped_addr) && mapped_addr < prgSize)
     {
-        data = vPRGMemory[mapped_addr];
+        data = prg[mapped_addr];
         return true;
     }
     return false;
@@ -88,10 +195,13 @@ bool Cartridge::CPUread(uint16_t addr, uint8_t &data)
 bool Cartridge::CPUwrite(uint16_t addr, uint8_t data)
 {
     uint32_t mapped_addr;
-    if (mapper->cpuMapWrite(addr, mapped_addr) && mapped_addr < vPRGMemory.size())
+    bool mapped = mapper->cpuMapWrite(addr, mapped_addr) && mapped_addr < prgSize;
+    if (mapper->ppuMapVersion() != chrMapVersion)
+        rebuildPatternMap();
+    if (mapped)
     {
-        if (mapped_addr < vPRGMemory.size())
-            vPRGMemory[mapped_addr] = data;
+        if (writablePRG)
+            writablePRG[mapped_addr] = data;
         return true;
     }
     return false;
@@ -100,9 +210,9 @@ bool Cartridge::CPUwrite(uint16_t addr, uint8_t data)
 bool Cartridge::PPUread(uint16_t addr, uint8_t &data)
 {
     uint32_t mapped_addr;
-    if (mapper->ppuMapRead(addr, mapped_addr) && mapped_addr < vCHRMemory.size())
+    if (mapper->ppuMapRead(addr, mapped_addr) && mapped_addr < chrSize)
     {
-        data = vCHRMemory[mapped_addr];
+        data = chr[mapped_addr];
         return true;
     }
     return false;
@@ -111,10 +221,36 @@ bool Cartridge::PPUread(uint16_t addr, uint8_t &data)
 bool Cartridge::PPUwrite(uint16_t addr, uint8_t data)
 {
     uint32_t mapped_addr;
-    if (mapper->ppuMapWrite(addr, mapped_addr) && mapped_addr < vCHRMemory.size())
+    if (chrRAM && mapper->ppuMapWrite(addr, mapped_addr) && mapped_addr < vCHRRAM.size())
     {
-        vCHRMemory[mapped_addr] = data;
+        vCHRRAM[mapped_addr] = data;
+        staleTiles[mapped_addr / 16] = 1;
         return true;
     }
     return false;
 }
+
+void Cartridge::saveState(StateWriter &out) const
+{
+    out.put(mirror);
+    if (chrRAM)
+        out.bytes(vCHRRAM.data(), vCHRRAM.size());
+    out.bytes(vNametableRAM.data(), vNametableRAM.size());
+}
+
+bool Cartridge::checkState(StateReader &in) const
+{
+    using Raw = std::underlying_type<MIRROR>::type;
+    return in.within<Raw>(0, Raw(MIRROR::FOUR_SCREEN));
+}
+
+void Cartridge::loadState(StateReader &in)
+{
+    in.get(mirror);
+    if (chrRAM)
+    {
+        in.bytes(vCHRRAM.data(), vCHRRAM.size());
+        std::fill(staleTiles.begin(), staleTiles.end(), 1);
+    }
+    in.bytes(vNametableRAM.data(), vNametableRAM.size());
+}
@@ -4,11 +4,51 @@
 #include <memory>
 #include "mappers/Mapper.h"
 
+class StateWriter;
+class StateReader;
+
+// One 8x8 tile of the pattern tables decoded to a color index (0-3) per
+// pixel, leftmost first, and the same rows mirrored for horizontal flip.
+// Renderers and debug views read these instead of slicing the two bit
+// planes of CHR pixel by pixel.
+struct PatternTile
+{
+    uint8_t rows[8][8];
+    uint8_t flipped[8][8];
+};
+void decodePatternTiles(const uint8_t *chr, size_t tiles, PatternTile *out);
+
+// What an iNES file holds, parsed once and never modified, so every Cartridge
+// running the same game can share one copy of PRG and CHR ROM.
+struct RomImage
+{
+    enum class MIRROR
+    {
+        HORIZONTAL,
+        VERTICAL,
+        ONE_SCREEN_LO,
+        ONE_SCREEN_HI,
+        FOUR_SCREEN
+    };
+
+    bool valid = false;
+    uint8_t mapperID = 0;
+    uint8_t prgBanks = 0; // 16 KB units
+    uint8_t chrBanks = 0; // 8 KB units, 0 means the board has 8 KB of CHR RAM
+    MIRROR mirror = MIRROR::HORIZONTAL;
+    std::vector<uint8_t> prg;
+    std::vector<uint8_t> chr;
+    std::vector<PatternTile> chrTiles; // chr decoded by load()
+
+    static std::shared_ptr<const RomImage> load(const std::string &filename);
+};
+
 class Cartridge
 {
 public:
     Cartridge() = default;
     Cartridge(const std::string &filename);
+    Cartridge(std::shared_ptr<const RomImage> image);
 
     bool isImageValid() const { return imageValid; }
 
@@ -17,19 +57,70 @@ public:
     bool PPUread(uint16_t addr, uint8_t &data);
     bool PPUwrite(uint16_t addr, uint8_t data);
 
-    enum class MIRROR
-    {
-        HORIZONTAL,
-        VERTICAL,
-        ONE_SCREEN_LO,
-        ONE_SCREEN_HI,
-        FOUR_SCREEN
-    };
+    using MIRROR = RomImage::MIRROR;
     MIRROR mirror = MIRROR::HORIZONTAL;
     MIRROR getMirror();
+    // Fills the PPU's four nametable pages: the mapper's choice if it makes
+    // one, else mirror over ciram, plus this board's own 2 KB for FOUR_SCREEN
+    void mapNametables(uint8_t *ciram, uint8_t *pages[4]);
+    std::vector<uint8_t> vNametableRAM; // FOUR_SCREEN boards only
     bool imageValid = false;
-    std::vector<uint8_t> vPRGMemory;
-    std::vector<uint8_t> vCHRMemory;
+
+    // PRG is ROM: writes reach the mapper but never change it. Test rigs that
+    // use the cartridge as flat RAM point writablePRG at an image of their own.
+    std::shared_ptr<const RomImage> rom;
+    const uint8_t *prg = nullptr;
+    size_t prgSize = 0;
+    uint8_t *writablePRG = nullptr;
+
+    // Pattern tables: the shared CHR ROM, or this cartridge's own CHR RAM
+    bool chrRAM = false;
+    std::vector<uint8_t> vCHRRAM;
+    const uint8_t *chr = nullptr;
+    size_t chrSize = 0;
+
+    // Pattern tables as the PPU sees them, per 1 KB slot of $0000-$1FFF: the
+    // CHR bytes and the index of the slot's first tile in tiles. Rebuilt on
+    // insert and whenever the mapper's ppuMapVersion() moves. A null chrPage
+    // is a slot the mapper doesn't map (it reads as 0). CHR RAM tiles are
+    // marked stale by PPUwrite and decoded again on their next use.
+    const uint8_t *chrPage[8] = {};
+    uint32_t chrTileBase[8] = {};
+    uint32_t chrMapVersion = 0;
+    void rebuildPatternMap();
+    // The tile holding addr. Not thread-safe even though the tile comes back
+    // const: a stale CHR RAM tile is decoded on the spot into this
+    // cartridge's ownTiles, and staleTiles is cleared. The ROM image's shared
+    // tiles are only read, never written, so cartridges sharing one image can
+    // run on different threads. Call it only from the thread that owns the
+    // cartridge.
+    const PatternTile &patternTile(uint16_t addr);
+
+    // Save state chunk: mirroring, CHR RAM and four-screen nametable RAM. PRG
+    // is treated as ROM and never saved; the mapper has a chunk of its own.
+    void saveState(StateWriter &out) const;
+    void loadState(StateReader &in);
+    bool checkState(StateReader &in) const; // false if mirroring is out of range
 
     std::unique_ptr<Mapper> mapper;
+
+private:
+    const PatternTile *tiles = nullptr; // the ROM image's, or ownTiles
+    std::vector<PatternTile> ownTiles;  // CHR RAM, or CHR ROM load() didn't decode
+    std::vector<uint8_t> staleTiles;    // CHR RAM tiles written since decoding
 };
+
+inline const PatternTile &Cartridge::patternTile(uint16_t addr)
+{
+    static const PatternTile blank{};
+    unsigned slot = (addr >> 10) & 0x07;
+    if (!chrPage[slot])
+        return blank;
+    uint32_t index = chrTileBase[slot] + ((addr & 0x03FF) >> 4);
+    if (chrRAM && staleTiles[index])
+    {
+        decodePatternTiles(chr + index * 16, 1, &ownTiles[index]);
+        staleTiles[index] = 0;
+    }
+    return tiles[index];
+}
@@ -1,306 +1,338 @@
 #include <string>
 #include <vector>
-#include <unordered_set>
 #include <cstdint>
+#include <cstring>
+#include <array>
 #include "CPU6502.h"
 #include "Bus.h"
+#include "SaveState.h"
 #include <sstream>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 using namespace std;
 
-CPU6502::CPU6502()
-{
-    using A = CPU6502;
-
-    checkpagecross = {0x10, 0x11, 0x19, 0x1C, 0x1D, 0x30, 0x31, 0x39, 0x3C, 0x3D,
-                      0x50, 0x51, 0x59, 0x5C, 0x5D, 0x70, 0x71, 0x79, 0x7C, 0x7D,
-                      0x90, 0xB0, 0xB1, 0xB3, 0xB9, 0xBB, 0xBC, 0xBD, 0xBE, 0xBF,
-                      0xD0, 0xD1, 0xD9, 0xDC, 0xDD, 0xF0, 0xF1, 0xF9, 0xFC, 0xFD};
-    lookup = {
-        {"BRK", &A::BRK, Addressing::IMP, 7},
-        {"ORA", &A::ORA, Addressing::IZX, 6},
-        {"KIL", &A::KIL, Addressing::IMP, 2},
-        {"SLO", &A::SLO, Addressing::IZX, 8},
-        {"NOP", &A::NOP, Addressing::ZP0, 3},
-        {"ORA", &A::ORA, Addressing::ZP0, 3},
-        {"ASL", &A::ASL, Addressing::ZP0, 5},
-        {"SLO", &A::SLO, Addressing::ZP0, 5},
-        {"PHP", &A::PHP, Addressing::IMP, 3},
-        {"ORA", &A::ORA, Addressing::IMM, 2},
-        {"ASL", &A::ASL, Addressing::IMP, 2},
-        {"ANC", &A::ANC, Addressing::IMM, 2},
-        {"NOP", &A::NOP, Addressing::ABS, 4},
-        {"ORA", &A::ORA, Addressing::ABS, 4},
-        {"ASL", &A::ASL, Addressing::ABS, 6},
-        {"SLO", &A::SLO, Addressing::ABS, 6},
-        {"BPL", &A::BPL, Addressing::REL, 2},
-        {"ORA", &A::ORA, Addressing::IZY, 5},
-        {"KIL", &A::KIL, Addressing::IMP, 2},
-        {"SLO", &A::SLO, Addressing::IZY, 8},
-        {"NOP", &A::NOP, Addressing::ZPX, 4},
-        {"ORA", &A::ORA, Addressing::ZPX, 4},
-        {"ASL", &A::ASL, Addressing::ZPX, 6},
-        {"SLO", &A::SLO, Addressing::ZPX, 6},
-        {"CLC", &A::CLC, Addressing::IMP, 2},
-        {"ORA", &A::ORA, Addressing::ABY, 4},
-        {"NOP", &A::NOP, Addressing::IMP, 2},
-        {"SLO", &A::SLO, Addressing::ABY, 7},
-        {"NOP", &A::NOP, Addressing::ABX, 4},
-        {"ORA", &A::ORA, Addressing::ABX, 4},
-        {"ASL", &A::ASL, Addressing::ABX, 7},
-        {"SLO", &A::SLO, Addressing::ABX, 7},
-        {"JSR", &A::JSR, Addressing::ABS, 6},
-        {"AND", &A::AND, Addressing::IZX, 6},
-        {"KIL", &A::KIL, Addressing::IMP, 2},
-        {"RLA", &A::RLA, Addressing::IZX, 8},
-        {"BIT", &A::BIT, Addressing::ZP0, 3},
-        {"AND", &A::AND, Addressing::ZP0, 3},
-        {"ROL", &A::ROL, Addressing::ZP0, 5},
-        {"RLA", &A::RLA, Addressing::ZP0, 5},
-        {"PLP", &A::PLP, Addressing::IMP, 4},
-        {"AND", &A::AND, Addressing::IMM, 2},
-        {"ROL", &A::ROL, Addressing::IMP, 2},
-        {"ANC", &A::ANC, Addressing::IMM, 2},
-        {"BIT", &A::BIT, Addressing::ABS, 4},
-        {"AND", &A::AND, Addressing::ABS, 4},
-        {"ROL", &A::ROL, Addressing::ABS, 6},
-        {"RLA", &A::RLA, Addressing::ABS, 6},
-        {"BMI", &A::BMI, Addressing::REL, 2},
-        {"AND", &A::AND, Addressing::IZY, 5},
-        {"KIL", &A::KIL, Addressing::IMP, 2},
-        {"RLA", &A::RLA, Addressing::IZY, 8},
-        {"NOP", &A::NOP, Addressing::ZPX, 4},
-        {"AND", &A::AND, Addressing::ZPX, 4},
-        {"ROL", &A::ROL, Addressing::ZPX, 6},
-        {"RLA", &A::RLA, Addressing::ZPX, 6},
-        {"SEC", &A::SEC, Addressing::IMP, 2},
-        {"AND", &A::AND, Addressing::ABY, 4},
-        {"NOP", &A::NOP, Addressing::IMP, 2},
-        {"RLA", &A::RLA, Addressing::ABY, 7},
-        {"NOP", &A::NOP, Addressing::ABX, 4},
-        {"AND", &A::AND, Addressing::ABX, 4},
-        {"ROL", &A::ROL, Addressing::ABX, 7},
-        {"RLA", &A::RLA, Addressing::ABX, 7},
-        {"RTI", &A::RTI, Addressing::IMP, 6},
-        {"EOR", &A::EOR, Addressing::IZX, 6},
-        {"KIL", &A::KIL, Addressing::IMP, 2},
-        {"SRE", &A::SRE, Addressing::IZX, 8},
-        {"NOP", &A::NOP, Addressing::ZP0, 3},
-        {"EOR", &A::EOR, Addressing::ZP0, 3},
-        {"LSR", &A::LSR, Addressing::ZP0, 5},
-        {"SRE", &A::SRE, Addressing::ZP0, 5},
-        {"PHA", &A::PHA, Addressing::IMP, 3},
-        {"EOR", &A::EOR, Addressing::IMM, 2},
-        {"LSR", &A::LSR, Addressing::IMP, 2},
-        {"ALR", &A::ALR, Addressing::IMM, 2},
-        {"JMP", &A::JMP, Addressing::ABS, 3},
-        {"EOR", &A::EOR, Addressing::ABS, 4},
-        {"LSR", &A::LSR, Addressing::ABS, 6},
-        {"SRE", &A::SRE, Addressing::ABS, 6},
-        {"BVC", &A::BVC, Addressing::REL, 2},
-        {"EOR", &A::EOR, Addressing::IZY, 5},
-        {"KIL", &A::KIL, Addressing::IMP, 2},
-        {"SRE", &A::SRE, Addressing::IZY, 8},
-        {"NOP", &A::NOP, Addressing::ZPX, 4},
-        {"EOR", &A::EOR, Addressing::ZPX, 4},
-        {"LSR", &A::LSR, Addressing::ZPX, 6},
-        {"SRE", &A::SRE, Addressing::ZPX, 6},
-        {"CLI", &A::CLI, Addressing::IMP, 2},
-        {"EOR", &A::EOR, Addressing::ABY, 4},
-        {"NOP", &A::NOP, Addressing::IMP, 2},
-        {"SRE", &A::SRE, Addressing::ABY, 7},
-        {"NOP", &A::NOP, Addressing::ABX, 4},
-        {"EOR", &A::EOR, Addressing::ABX, 4},
-        {"LSR", &A::LSR, Addressing::ABX, 7},
-        {"SRE", &A::SRE, Addressing::ABX, 7},
-        {"RTS", &A::RTS, Addressing::IMP, 6},
-        {"ADC", &A::ADC, Addressing::IZX, 6},
-        {"KIL", &A::KIL, Addressing::IMP, 2},
-        {"RRA", &A::RRA, Addressing::IZX, 8},
-        {"NOP", &A::NOP, Addressing::ZP0, 3},
-        {"ADC", &A::ADC, Addressing::ZP0, 3},
-        {"ROR", &A::ROR, Addressing::ZP0, 5},
-        {"RRA", &A::RRA, Addressing::ZP0, 5},
-        {"PLA", &A::PLA, Addressing::IMP, 4},
-        {"ADC", &A::ADC, Addressing::IMM, 2},
-        {"ROR", &A::ROR, Addressing::IMP, 2},
-        {"ARR", &A::ARR, Addressing::IMM, 2},
-        {"JMP", &A::JMP, Addressing::IND, 5},
-        {"ADC", &A::ADC, Addressing::ABS, 4},
-        {"ROR", &A::ROR, Addressing::ABS, 6},
-        {"RRA", &A::RRA, Addressing::ABS, 6},
-        {"BVS", &A::BVS, Addressing::REL, 2},
-        {"ADC", &A::ADC, Addressing::IZY, 5},
-        {"KIL", &A::KIL, Addressing::IMP, 2},
-        {"RRA", &A::RRA, Addressing::IZY, 8},
-        {"NOP", &A::NOP, Addressing::ZPX, 4},
-        {"ADC", &A::ADC, Addressing::ZPX, 4},
-        {"ROR", &A::ROR, Addressing::ZPX, 6},
-        {"RRA", &A::RRA, Addressing::ZPX, 6},
-        {"SEI", &A::SEI, Addressing::IMP, 2},
-        {"ADC", &A::ADC, Addressing::ABY, 4},
-        {"NOP", &A::NOP, Addressing::IMP, 2},
-        {"RRA", &A::RRA, Addressing::ABY, 7},
-        {"NOP", &A::NOP, Addressing::ABX, 4},
-        {"ADC", &A::ADC, Addressing::ABX, 4},
-        {"ROR", &A::ROR, Addressing::ABX, 7},
-        {"RRA", &A::RRA, Addressing::ABX, 7},
-        {"NOP", &A::NOP, Addressing::IMM, 2},
-        {"STA", &A::STA, Addressing::IZX, 6},
-        {"NOP", &A::NOP, Addressing::IMM, 2},
-        {"SAX", &A::SAX, Addressing::IZX, 6},
-        {"STY", &A::STY, Addressing::ZP0, 3},
-        {"STA", &A::STA, Addressing::ZP0, 3},
-        {"STX", &A::STX, Addressing::ZP0, 3},
-        {"SAX", &A::SAX, Addressing::ZP0, 3},
-        {"DEY", &A::DEY, Addressing::IMP, 2},
-        {"NOP", &A::NOP, Addressing::IMM, 2},
-        {"TXA", &A::TXA, Addressing::IMP, 2},
-        {"XAA", &A::XAA, Addressing::IMM, 2},
-        {"STY", &A::STY, Addressing::ABS, 4},
-        {"STA", &A::STA, Addressing::ABS, 4},
-        {"STX", &A::STX, Addressing::ABS, 4},
-        {"SAX", &A::SAX, Addressing::ABS, 4},
-        {"BCC", &A::BCC, Addressing::REL, 2},
-        {"STA", &A::STA, Addressing::IZY, 6},
-        {"KIL", &A::KIL, Addressing::IMP, 2},
-        {"AHX", &A::AHX, Addressing::IZY, 6},
-        {"STY", &A::STY, Addressing::ZPX, 4},
-        {"STA", &A::STA, Addressing::ZPX, 4},
-        {"STX", &A::STX, Addressing::ZPY, 4},
-        {"SAX", &A::SAX, Addressing::ZPY, 4},
-        {"TYA", &A::TYA, Addressing::IMP, 2},
-        {"STA", &A::STA, Addressing::ABY, 5},
-        {"TXS", &A::TXS, Addressing::IMP, 2},
-        {"TAS", &A::TAS, Addressing::ABY, 5},
-        {"NOP", &A::NOP, Addressing::ABX, 5},
-        {"STA", &A::STA, Addressing::ABX, 5},
-        {"SHX", &A::SHX, Addressing::ABY, 5},
-        {"AHX", &A::AHX, Addressing::ABY, 5},
-        {"LDY", &A::LDY, Addressing::IMM, 2},
-        {"LDA", &A::LDA, Addressing::IZX, 6},
-        {"LDX", &A::LDX, Addressing::IMM, 2},
-        {"LAX", &A::LAX, Addressing::IZX, 6},
-        {"LDY", &A::LDY, Addressing::ZP0, 3},
-        {"LDA", &A::LDA, Addressing::ZP0, 3},
-        {"LDX", &A::LDX, Addressing::ZP0, 3},
-        {"LAX", &A::LAX, Addressing::ZP0, 3},
-        {"TAY", &A::TAY, Addressing::IMP, 2},
-        {"LDA", &A::LDA, Addressing::IMM, 2},
-        {"TAX", &A::TAX, Addressing::IMP, 2},
-        {"LAX", &A::LAX, Addressing::IMM, 2},
-        {"LDY", &A::LDY, Addressing::ABS, 4},
-        {"LDA", &A::LDA, Addressing::ABS, 4},
-        {"LDX", &A::LDX, Addressing::ABS, 4},
-        {"LAX", &A::LAX, Addressing::ABS, 4},
-        {"BCS", &A::BCS, Addressing::REL, 2},
-        {"LDA", &A::LDA, Addressing::IZY, 5},
-        {"KIL", &A::KIL, Addressing::IMP, 2},
-        {"LAX", &A::LAX, Addressing::IZY, 5},
-        {"LDY", &A::LDY, Addressing::ZPX, 4},
-        {"LDA", &A::LDA, Addressing::ZPX, 4},
-        {"LDX", &A::LDX, Addressing::ZPY, 4},
-        {"LAX", &A::LAX, Addressing::ZPY, 4},
-        {"CLV", &A::CLV, Addressing::IMP, 2},
-        {"LDA", &A::LDA, Addressing::ABY, 4},
-        {"TSX", &A::TSX, Addressing::IMP, 2},
-        {"LAS", &A::LAS, Addressing::ABY, 4},
-        {"LDY", &A::LDY, Addressing::ABX, 4},
-        {"LDA", &A::LDA, Addressing::ABX, 4},
-        {"LDX", &A::LDX, Addressing::ABY, 4},
-        {"LAX", &A::LAX, Addressing::ABY, 4},
-        {"CPY", &A::CPY, Addressing::IMM, 2},
-        {"CMP", &A::CMP, Addressing::IZX, 6},
-        {"NOP", &A::NOP, Addressing::IMM, 2},
-        {"DCP", &A::DCP, Addressing::IZX, 8},
-        {"CPY", &A::CPY, Addressing::ZP0, 3},
-        {"CMP", &A::CMP, Addressing::ZP0, 3},
-        {"DEC", &A::DEC, Addressing::ZP0, 5},
-        {"DCP", &A::DCP, Addressing::ZP0, 5},
-        {"INY", &A::INY, Addressing::IMP, 2},
-        {"CMP", &A::CMP, Addressing::IMM, 2},
-        {"DEX", &A::DEX, Addressing::IMP, 2},
-        {"AXS", &A::AXS, Addressing::IMM, 2},
-        {"CPY", &A::CPY, Addressing::ABS, 4},
-        {"CMP", &A::CMP, Addressing::ABS, 4},
-        {"DEC", &A::DEC, Addressing::ABS, 6},
-        {"DCP", &A::DCP, Addressing::ABS, 6},
-        {"BNE", &A::BNE, Addressing::REL, 2},
-        {"CMP", &A::CMP, Addressing::IZY, 5},
-        {"KIL", &A::KIL, Addressing::IMP, 2},
-        {"DCP", &A::DCP, Addressing::IZY, 8},
-        {"NOP", &A::NOP, Addressing::ZPX, 4},
-        {"CMP", &A::CMP, Addressing::ZPX, 4},
-        {"DEC", &A::DEC, Addressing::ZPX, 6},
-        {"DCP", &A::DCP, Addressing::ZPX, 6},
-        {"CLD", &A::CLD, Addressing::IMP, 2},
-        {"CMP", &A::CMP, Addressing::ABY, 4},
-        {"NOP", &A::NOP, Addressing::IMP, 2},
-        {"DCP", &A::DCP, Addressing::ABY, 7},
-        {"NOP", &A::NOP, Addressing::ABX, 4},
-        {"CMP", &A::CMP, Addressing::ABX, 4},
-        {"DEC", &A::DEC, Addressing::ABX, 7},
-        {"DCP", &A::DCP, Addressing::ABX, 7},
-        {"CPX", &A::CPX, Addressing::IMM, 2},
-        {"SBC", &A::SBC, Addressing::IZX, 6},
-        {"NOP", &A::NOP, Addressing::IMM, 2},
-        {"ISC", &A::ISC, Addressing::IZX, 8},
-        {"CPX", &A::CPX, Addressing::ZP0, 3},
-        {"SBC", &A::SBC, Addressing::ZP0, 3},
-        {"INC", &A::INC, Addressing::ZP0, 5},
-        {"ISC", &A::ISC, Addressing::ZP0, 5},
-        {"INX", &A::INX, Addressing::IMP, 2},
-        {"SBC", &A::SBC, Addressing::IMM, 2},
-        {"NOP", &A::NOP, Addressing::IMP, 2},
-        {"SBC", &A::SBC, Addressing::IMM, 2},
-        {"CPX", &A::CPX, Addressing::ABS, 4},
-        {"SBC", &A::SBC, Addressing::ABS, 4},
-        {"INC", &A::INC, Addressing::ABS, 6},
-        {"ISC", &A::ISC, Addressing::ABS, 6},
-        {"BEQ", &A::BEQ, Addressing::REL, 2},
-        {"SBC", &A::SBC, Addressing::IZY, 5},
-        {"KIL", &A::KIL, Addressing::IMP, 2},
-        {"ISC", &A::ISC, Addressing::IZY, 8},
-        {"NOP", &A::NOP, Addressing::ZPX, 4},
-        {"SBC", &A::SBC, Addressing::ZPX, 4},
-        {"INC", &A::INC, Addressing::ZPX, 6},
-        {"ISC", &A::ISC, Addressing::ZPX, 6},
-        {"SED", &A::SED, Addressing::IMP, 2},
-        {"SBC", &A::SBC, Addressing::ABY, 4},
-        {"NOP", &A::NOP, Addressing::IMP, 2},
-        {"ISC", &A::ISC, Addressing::ABY, 7},
-        {"NOP", &A::NOP, Addressing::ABX, 4},
-        {"SBC", &A::SBC, Addressing::ABX, 4},
-        {"INC", &A::INC, Addressing::ABX, 7},
-        {"ISC", &A::ISC, Addressing::ABX, 7},
-    };
-}
+// Opcode table, built at compile time. Last column marks the indexed reads that
+// take +1 cycle on a page cross (branches add their own penalty).
+constexpr CPU6502::instruction CPU6502::lookup[256] = {
+    {"BRK", &CPU6502::BRK, Addressing::IMP, 7},
+    {"ORA", &CPU6502::ORA, Addressing::IZX, 6},
+    {"KIL", &CPU6502::KIL, Addressing::IMP, 2},
+    {"SLO", &CPU6502::SLO, Addressing::IZX, 8},
+    {"NOP", &CPU6502::IGN, Addressing::ZP0, 3},
+    {"ORA", &CPU6502::ORA, Addressing::ZP0, 3},
+    {"ASL", &CPU6502::ASL, Addressing::ZP0, 5},
+    {"SLO", &CPU6502::SLO, Addressing::ZP0, 5},
+    {"PHP", &CPU6502::PHP, Addressing::IMP, 3},
+    {"ORA", &CPU6502::ORA, Addressing::IMM, 2},
+    {"ASL", &CPU6502::ASL_A, Addressing::ACC, 2},
+    {"ANC", &CPU6502::ANC, Addressing::IMM, 2},
+    {"NOP", &CPU6502::IGN, Addressing::ABS, 4},
+    {"ORA", &CPU6502::ORA, Addressing::ABS, 4},
+    {"ASL", &CPU6502::ASL, Addressing::ABS, 6},
+    {"SLO", &CPU6502::SLO, Addressing::ABS, 6},
+    {"BPL", &CPU6502::BPL, Addressing::REL, 2},
+    {"ORA", &CPU6502::ORA, Addressing::IZY, 5, true},
+    {"KIL", &CPU6502::KIL, Addressing::IMP, 2},
+    {"SLO", &CPU6502::SLO, Addressing::IZY, 8},
+    {"NOP", &CPU6502::IGN, Addressing::ZPX, 4},
+    {"ORA", &CPU6502::ORA, Addressing::ZPX, 4},
+    {"ASL", &CPU6502::ASL, Addressing::ZPX, 6},
+    {"SLO", &CPU6502::SLO, Addressing::ZPX, 6},
+    {"CLC", &CPU6502::CLC, Addressing::IMP, 2},
+    {"ORA", &CPU6502::ORA, Addressing::ABY, 4, true},
+    {"NOP", &CPU6502::NOP, Addressing::IMP, 2},
+    {"SLO", &CPU6502::SLO, Addressing::ABY, 7},
+    {"NOP", &CPU6502::IGN, Addressing::ABX, 4, true},
+    {"ORA", &CPU6502::ORA, Addressing::ABX, 4, true},
+    {"ASL", &CPU6502::ASL, Addressing::ABX, 7},
+    {"SLO", &CPU6502::SLO, Addressing::ABX, 7},
+    {"JSR", &CPU6502::JSR, Addressing::ABS, 6},
+    {"AND", &CPU6502::AND, Addressing::IZX, 6},
+    {"KIL", &CPU6502::KIL, Addressing::IMP, 2},
+    {"RLA", &CPU6502::RLA, Addressing::IZX, 8},
+    {"BIT", &CPU6502::BIT, Addressing::ZP0, 3},
+    {"AND", &CPU6502::AND, Addressing::ZP0, 3},
+    {"ROL", &CPU6502::ROL, Addressing::ZP0, 5},
+    {"RLA", &CPU6502::RLA, Addressing::ZP0, 5},
+    {"PLP", &CPU6502::PLP, Addressing::IMP, 4},
+    {"AND", &CPU6502::AND, Addressing::IMM, 2},
+    {"ROL", &CPU6502::ROL_A, Addressing::ACC, 2},
+    {"ANC", &CPU6502::ANC, Addressing::IMM, 2},
+    {"BIT", &CPU6502::BIT, Addressing::ABS, 4},
+    {"AND", &CPU6502::AND, Addressing::ABS, 4},
+    {"ROL", &CPU6502::ROL, Addressing::ABS, 6},
+    {"RLA", &CPU6502::RLA, Addressing::ABS, 6},
+    {"BMI", &CPU6502::BMI, Addressing::REL, 2},
+    {"AND", &CPU6502::AND, Addressing::IZY, 5, true},
+    {"KIL", &CPU6502::KIL, Addressing::IMP, 2},
+    {"RLA", &CPU6502::RLA, Addressing::IZY, 8},
+    {"NOP", &CPU6502::IGN, Addressing::ZPX, 4},
+    {"AND", &CPU6502::AND, Addressing::ZPX, 4},
+    {"ROL", &CPU6502::ROL, Addressing::ZPX, 6},
+    {"RLA", &CPU6502::RLA, Addressing::ZPX, 6},
+    {"SEC", &CPU6502::SEC, Addressing::IMP, 2},
+    {"AND", &CPU6502::AND, Addressing::ABY, 4, true},
+    {"NOP", &CPU6502::NOP, Addressing::IMP, 2},
+    {"RLA", &CPU6502::RLA, Addressing::ABY, 7},
+    {"NOP", &CPU6502::IGN, Addressing::ABX, 4, true},
+    {"AND", &CPU6502::AND, Addressing::ABX, 4, true},
+    {"ROL", &CPU6502::ROL, Addressing::ABX, 7},
+    {"RLA", &CPU6502::RLA, Addressing::ABX, 7},
+    {"RTI", &CPU6502::RTI, Addressing::IMP, 6},
+    {"EOR", &CPU6502::EOR, Addressing::IZX, 6},
+    {"KIL", &CPU6502::KIL, Addressing::IMP, 2},
+    {"SRE", &CPU6502::SRE, Addressing::IZX, 8},
+    {"NOP", &CPU6502::IGN, Addressing::ZP0, 3},
+    {"EOR", &CPU6502::EOR, Addressing::ZP0, 3},
+    {"LSR", &CPU6502::LSR, Addressing::ZP0, 5},
+    {"SRE", &CPU6502::SRE, Addressing::ZP0, 5},
+    {"PHA", &CPU6502::PHA, Addressing::IMP, 3},
+    {"EOR", &CPU6502::EOR, Addressing::IMM, 2},
+    {"LSR", &CPU6502::LSR_A, Addressing::ACC, 2},
+    {"ALR", &CPU6502::ALR, Addressing::IMM, 2},
+    {"JMP", &CPU6502::JMP, Addressing::ABS, 3},
+    {"EOR", &CPU6502::EOR, Addressing::ABS, 4},
+    {"LSR", &CPU6502::LSR, Addressing::ABS, 6},
+    {"SRE", &CPU6502::SRE, Addressing::ABS, 6},
+    {"BVC", &CPU6502::BVC, Addressing::REL, 2},
+    {"EOR", &CPU6502::EOR, Addressing::IZY, 5, true},
+    {"KIL", &CPU6502::KIL, Addressing::IMP, 2},
+    {"SRE", &CPU6502::SRE, Addressing::IZY, 8},
+    {"NOP", &CPU6502::IGN, Addressing::ZPX, 4},
+    {"EOR", &CPU6502::EOR, Addressing::ZPX, 4},
+    {"LSR", &CPU6502::LSR, Addressing::ZPX, 6},
+    {"SRE", &CPU6502::SRE, Addressing::ZPX, 6},
+    {"CLI", &CPU6502::CLI, Addressing::IMP, 2},
+    {"EOR", &CPU6502::EOR, Addressing::ABY, 4, true},
+    {"NOP", &CPU6502::NOP, Addressing::IMP, 2},
+    {"SRE", &CPU6502::SRE, Addressing::ABY, 7},
+    {"NOP", &CPU6502::IGN, Addressing::ABX, 4, true},
+    {"EOR", &CPU6502::EOR, Addressing::ABX, 4, true},
+    {"LSR", &CPU6502::LSR, Addressing::ABX, 7},
+    {"SRE", &CPU6502::SRE, Addressing::ABX, 7},
+    {"RTS", &CPU6502::RTS, Addressing::IMP, 6},
+    {"ADC", &CPU6502::ADC, Addressing::IZX, 6},
+    {"KIL", &CPU6502::KIL, Addressing::IMP, 2},
+    {"RRA", &CPU6502::RRA, Addressing::IZX, 8},
+    {"NOP", &CPU6502::IGN, Addressing::ZP0, 3},
+    {"ADC", &CPU6502::ADC, Addressing::ZP0, 3},
+    {"ROR", &CPU6502::ROR, Addressing::ZP0, 5},
+    {"RRA", &CPU6502::RRA, Addressing::ZP0, 5},
+    {"PLA", &CPU6502::PLA, Addressing::IMP, 4},
+    {"ADC", &CPU6502::ADC, Addressing::IMM, 2},
+    {"ROR", &CPU6502::ROR_A, Addressing::ACC, 2},
+    {"ARR", &CPU6502::ARR, Addressing::IMM, 2},
+    {"JMP", &CPU6502::JMP, Addressing::IND, 5},
+    {"ADC", &CPU6502::ADC, Addressing::ABS, 4},
+    {"ROR", &CPU6502::ROR, Addressing::ABS, 6},
+    {"RRA", &CPU6502::RRA, Addressing::ABS, 6},
+    {"BVS", &CPU6502::BVS, Addressing::REL, 2},
+    {"ADC", &CPU6502::ADC, Addressing::IZY, 5, true},
+    {"KIL", &CPU6502::KIL, Addressing::IMP, 2},
+    {"RRA", &CPU6502::RRA, Addressing::IZY, 8},
+    {"NOP", &CPU6502::IGN, Addressing::ZPX, 4},
+    {"ADC", &CPU6502::ADC, Addressing::ZPX, 4},
+    {"ROR", &CPU6502::ROR, Addressing::ZPX, 6},
+    {"RRA", &CPU6502::RRA, Addressing::ZPX, 6},
+    {"SEI", &CPU6502::SEI, Addressing::IMP, 2},
+    {"ADC", &CPU6502::ADC, Addressing::ABY, 4, true},
+    {"NOP", &CPU6502::NOP, Addressing::IMP, 2},
+    {"RRA", &CPU6502::RRA, Addressing::ABY, 7},
+    {"NOP", &CPU6502::IGN, Addressing::ABX, 4, true},
+    {"ADC", &CPU6502::ADC, Addressing::ABX, 4, true},
+    {"ROR", &CPU6502::ROR, Addressing::ABX, 7},
+    {"RRA", &CPU6502::RRA, Addressing::ABX, 7},
+    {"NOP", &CPU6502::IGN, Addressing::IMM, 2},
+    {"STA", &CPU6502::STA, Addressing::IZX, 6},
+    {"NOP", &CPU6502::IGN, Addressing::IMM, 2},
+    {"SAX", &CPU6502::SAX, Addressing::IZX, 6},
+    {"STY", &CPU6502::STY, Addressing::ZP0, 3},
+    {"STA", &CPU6502::STA, Addressing::ZP0, 3},
+    {"STX", &CPU6502::STX, Addressing::ZP0, 3},
+    {"SAX", &CPU6502::SAX, Addressing::ZP0, 3},
+    {"DEY", &CPU6502::DEY, Addressing::IMP, 2},
+    {"NOP", &CPU6502::IGN, Addressing::IMM, 2},
+    {"TXA", &CPU6502::TXA, Addressing::IMP, 2},
+    {"XAA", &CPU6502::XAA, Addressing::IMM, 2},
+    {"STY", &CPU6502::STY, Addressing::ABS, 4},
+    {"STA", &CPU6502::STA, Addressing::ABS, 4},
+    {"STX", &CPU6502::STX, Addressing::ABS, 4},
+    {"SAX", &CPU6502::SAX, Addressing::ABS, 4},
+    {"BCC", &CPU6502::BCC, Addressing::REL, 2},
+    {"STA", &CPU6502::STA, Addressing::IZY, 6},
+    {"KIL", &CPU6502::KIL, Addressing::IMP, 2},
+    {"AHX", &CPU6502::AHX, Addressing::IZY, 6},
+    {"STY", &CPU6502::STY, Addressing::ZPX, 4},
+    {"STA", &CPU6502::STA, Addressing::ZPX, 4},
+    {"STX", &CPU6502::STX, Addressing::ZPY, 4},
+    {"SAX", &CPU6502::SAX, Addressing::ZPY, 4},
+    {"TYA", &CPU6502::TYA, Addressing::IMP, 2},
+    {"STA", &CPU6502::STA, Addressing::ABY, 5},
+    {"TXS", &CPU6502::TXS, Addressing::IMP, 2},
+    {"TAS", &CPU6502::TAS, Addressing::ABY, 5},
+    {"NOP", &CPU6502::IGN, Addressing::ABX, 5},
+    {"STA", &CPU6502::STA, Addressing::ABX, 5},
+    {"SHX", &CPU6502::SHX, Addressing::ABY, 5},
+    {"AHX", &CPU6502::AHX, Addressing::ABY, 5},
+    {"LDY", &CPU6502::LDY, Addressing::IMM, 2},
+    {"LDA", &CPU6502::LDA, Addressing::IZX, 6},
+    {"LDX", &CPU6502::LDX, Addressing::IMM, 2},
+    {"LAX", &CPU6502::LAX, Addressing::IZX, 6},
+    {"LDY", &CPU6502::LDY, Addressing::ZP0, 3},
+    {"LDA", &CPU6502::LDA, Addressing::ZP0, 3},
+    {"LDX", &CPU6502::LDX, Addressing::ZP0, 3},
+    {"LAX", &CPU6502::LAX, Addressing::ZP0, 3},
+    {"TAY", &CPU6502::TAY, Addressing::IMP, 2},
+    {"LDA", &CPU6502::LDA, Addressing::IMM, 2},
+    {"TAX", &CPU6502::TAX, Addressing::IMP, 2},
+    {"LAX", &CPU6502::LAX, Addressing::IMM, 2},
+    {"LDY", &CPU6502::LDY, Addressing::ABS, 4},
+    {"LDA", &CPU6502::LDA, Addressing::ABS, 4},
+    {"LDX", &CPU6502::LDX, Addressing::ABS, 4},
+    {"LAX", &CPU6502::LAX, Addressing::ABS, 4},
+    {"BCS", &CPU6502::BCS, Addressing::REL, 2},
+    {"LDA", &CPU6502::LDA, Addressing::IZY, 5, true},
+    {"KIL", &CPU6502::KIL, Addressing::IMP, 2},
+    {"LAX", &CPU6502::LAX, Addressing::IZY, 5, true},
+    {"LDY", &CPU6502::LDY, Addressing::ZPX, 4},
+    {"LDA", &CPU6502::LDA, Addressing::ZPX, 4},
+    {"LDX", &CPU6502::LDX, Addressing::ZPY, 4},
+    {"LAX", &CPU6502::LAX, Addressing::ZPY, 4},
+    {"CLV", &CPU6502::CLV, Addressing::IMP, 2},
+    {"LDA", &CPU6502::LDA, Addressing::ABY, 4, true},
+    {"TSX", &CPU6502::TSX, Addressing::IMP, 2},
+    {"LAS", &CPU6502::LAS, Addressing::ABY, 4, true},
+    {"LDY", &CPU6502::LDY, Addressing::ABX, 4, true},
+    {"LDA", &CPU6502::LDA, Addressing::ABX, 4, true},
+    {"LDX", &CPU6502::LDX, Addressing::ABY, 4, true},
+    {"LAX", &CPU6502::LAX, Addressing::ABY, 4, true},
+    {"CPY", &CPU6502::CPY, Addressing::IMM, 2},
+    {"CMP", &CPU6502::CMP, Addressing::IZX, 6},
+    {"NOP", &CPU6502::IGN, Addressing::IMM, 2},
+    {"DCP", &CPU6502::DCP, Addressing::IZX, 8},
+    {"CPY", &CPU6502::CPY, Addressing::ZP0, 3},
+    {"CMP", &CPU6502::CMP, Addressing::ZP0, 3},
+    {"DEC", &CPU6502::DEC, Addressing::ZP0, 5},
+    {"DCP", &CPU6502::DCP, Addressing::ZP0, 5},
+    {"INY", &CPU6502::INY, Addressing::IMP, 2},
+    {"CMP", &CPU6502::CMP, Addressing::IMM, 2},
+    {"DEX", &CPU6502::DEX, Addressing::IMP, 2},
+    {"AXS", &CPU6502::AXS, Addressing::IMM, 2},
+    {"CPY", &CPU6502::CPY, Addressing::ABS, 4},
+    {"CMP", &CPU6502::CMP, Addressing::ABS, 4},
+    {"DEC", &CPU6502::DEC, Addressing::ABS, 6},
+    {"DCP", &CPU6502::DCP, Addressing::ABS, 6},
+    {"BNE", &CPU6502::BNE, Addressing::REL, 2},
+    {"CMP", &CPU6502::CMP, Addressing::IZY, 5, true},
+    {"KIL", &CPU6502::KIL, Addressing::IMP, 2},
+    {"DCP", &CPU6502::DCP, Addressing::IZY, 8},
+    {"NOP", &CPU6502::IGN, Addressing::ZPX, 4},
+    {"CMP", &CPU6502::CMP, Addressing::ZPX, 4},
+    {"DEC", &CPU6502::DEC, Addressing::ZPX, 6},
+    {"DCP", &CPU6502::DCP, Addressing::ZPX, 6},
+    {"CLD", &CPU6502::CLD, Addressing::IMP, 2},
+    {"CMP", &CPU6502::CMP, Addressing::ABY, 4, true},
+    {"NOP", &CPU6502::NOP, Addressing::IMP, 2},
+    {"DCP", &CPU6502::DCP, Addressing::ABY, 7},
+    {"NOP", &CPU6502::IGN, Addressing::ABX, 4, true},
+    {"CMP", &CPU6502::CMP, Addressing::ABX, 4, true},
+    {"DEC", &CPU6502::DEC, Addressing::ABX, 7},
+    {"DCP", &CPU6502::DCP, Addressing::ABX, 7},
+    {"CPX", &CPU6502::CPX, Addressing::IMM, 2},
+    {"SBC", &CPU6502::SBC, Addressing::IZX, 6},
+    {"NOP", &CPU6502::IGN, Addressing::IMM, 2},
+    {"ISC", &CPU6502::ISC, Addressing::IZX, 8},
+    {"CPX", &CPU6502::CPX, Addressing::ZP0, 3},
+    {"SBC", &CPU6502::SBC, Addressing::ZP0, 3},
+    {"INC", &CPU6502::INC, Addressing::ZP0, 5},
+    {"ISC", &CPU6502::ISC, Addressing::ZP0, 5},
+    {"INX", &CPU6502::INX, Addressing::IMP, 2},
+    {"SBC", &CPU6502::SBC, Addressing::IMM, 2},
+    {"NOP", &CPU6502::NOP, Addressing::IMP, 2},
+    {"SBC", &CPU6502::SBC, Addressing::IMM, 2},
+    {"CPX", &CPU6502::CPX, Addressing::ABS, 4},
+    {"SBC", &CPU6502::SBC, Addressing::ABS, 4},
+    {"INC", &CPU6502::INC, Addressing::ABS, 6},
+    {"ISC", &CPU6502::ISC, Addressing::ABS, 6},
+    {"BEQ", &CPU6502::BEQ, Addressing::REL, 2},
+    {"SBC", &CPU6502::SBC, Addressing::IZY, 5, true},
+    {"KIL", &CPU6502::KIL, Addressing::IMP, 2},
+    {"ISC", &CPU6502::ISC, Addressing::IZY, 8},
+    {"NOP", &CPU6502::IGN, Addressing::ZPX, 4},
+    {"SBC", &CPU6502::SBC, Addressing::ZPX, 4},
+    {"INC", &CPU6502::INC, Addressing::ZPX, 6},
+    {"ISC", &CPU6502::ISC, Addressing::ZPX, 6},
+    {"SED", &CPU6502::SED, Addressing::IMP, 2},
+    {"SBC", &CPU6502::SBC, Addressing::ABY, 4, true},
+    {"NOP", &CPU6502::NOP, Addressing::IMP, 2},
+    {"ISC", &CPU6502::ISC, Addressing::ABY, 7},
+    {"NOP", &CPU6502::IGN, Addressing::ABX, 4, true},
+    {"SBC", &CPU6502::SBC, Addressing::ABX, 4, true},
+    {"INC", &CPU6502::INC, Addressing::ABX, 7},
+    {"ISC", &CPU6502::ISC, Addressing::ABX, 7},
+};
 
 void CPU6502::connectBus(Bus *bus)
 {
     this->bus = bus;
+    dropCompiled(); // native code has the bus baked in
 }
 
 uint8_t CPU6502::read(uint16_t addr)
 {
+    uint8_t data = fetch(addr);
+    if constexpr (Accuracy::cycleAccurate)
+        busCycle++;
+    return data;
+}
+
+uint8_t CPU6502::fetch(uint16_t addr)
+{
+    if (const uint8_t *page = bus->readPage[addr >> 8])
+    {
+        return page[addr & 0xFF];
+    }
     return bus->CPUread(addr);
 }
 
+void CPU6502::dummyRead(uint16_t addr)
+{
+    if constexpr (Accuracy::cycleAccurate)
+        read(addr);
+}
+
+uint8_t CPU6502::readModify(uint16_t addr)
+{
+    uint8_t data = read(addr);
+    if constexpr (Accuracy::cycleAccurate)
+        write(addr, data); // the 6502 writes the old value back first
+    return data;
+}
+
 uint16_t CPU6502::read16(std::uint16_t addr)
 {
-    return bus->CPUread16(addr);
+    return read(addr) | (read(addr + 1) << 8);
 }
 
 void CPU6502::write(std::uint16_t addr, std::uint8_t data)
 {
-    bus->CPUwrite(addr, data);
+    if (uint8_t *page = bus->writePage[addr >> 8])
+    {
+        page[addr & 0xFF] = data;
+        ramWritten(addr);
+    }
+    else
+    {
+        bus->CPUwrite(addr, data);
+    }
+    if constexpr (Accuracy::cycleAccurate)
+        busCycle++;
 }
 
 void CPU6502::push(std::uint8_t data)
 {
-    bus->CPUwrite(0x0100 + SP--, data);
+    write(0x0100 + SP--, data);
 }
 
 void CPU6502::push16(std::uint16_t data)
@@ -352,31 +384,53 @@ void CPU6502::performDMA()
         // End when addr wraps back to 0
         if (bus->dma.addr == 0x00)
         {
-            bus->dma.transfer = false;
             bus->dma.dummy = true;
+            bus->interrupts.clear(Bus::Interrupts::DMA);
         }
     }
 }
 
 void CPU6502::AcknowledgeNMI()
 {
-    bus->ppu.nmiOccurred = false;
+    bus->interrupts.clear(Bus::Interrupts::NMI);
 }
 
-void CPU6502::clock()
+bool CPU6502::irqDue() const
 {
-    // DMA always stops CPU entirely
-    if (bus->dma.transfer)
+    return (bus->interrupts.pending & Bus::Interrupts::IRQ) && !status.i;
+}
+
+bool CPU6502::pollInterrupts(bool nmiDue)
+{
+    if ((bus->interrupts.pending & Bus::Interrupts::NMI) && nmiDue)
     {
-        performDMA();
-        totalcycles++;
-        return;
+        nmi();
+        return true;
+    }
+    if (irqDue())
+    {
+        irq();
+        return true;
     }
+    return false;
+}
 
-    // Only run CPU when no DMA
-    if (bus->ppu.nmiOccurred) 
+void CPU6502::clock()
+{
+    if (bus->interrupts.pending)
     {
-        nmi();
+        // DMA always stops CPU entirely
+        if (bus->interrupts.pending & Bus::Interrupts::DMA)
+        {
+            performDMA();
+            totalcycles++;
+            return;
+        }
+        // Lines are only polled between instructions
+        if (cycles == 0)
+        {
+            pollInterrupts(true);
+        }
     }
 
     if (cycles == 0)
@@ -387,6 +441,23 @@ void CPU6502::clock()
     cycles--;
 }
 
+uint8_t CPU6502::step()
+{
+    // The 6502 polls its interrupt lines before the last cycle of an
+    // instruction, so an NMI edge that arrived during the final cycle of the
+    // previous one waits for one more instruction.
+    Bus::Interrupts &lines = bus->interrupts;
+    if (!lines.pending || !pollInterrupts(lines.nmiAt + 3 <= bus->masterClock))
+    {
+        execute();
+    }
+
+    uint8_t taken = cycles;
+    cycles = 0;
+    busCycle = 0;
+    return taken;
+}
+
 void CPU6502::reset()
 {
     PC = read16(0xFFFC);
@@ -394,15 +465,18 @@ void CPU6502::reset()
     X = 0;
     Y = 0;
     SP = 0xFD;
-    status.value = 0x24;
+    status.from_byte(0x24);
     cycles = 7;
+    idleClean = false;
 }
 
 void CPU6502::nmi()
 {
     AcknowledgeNMI();
+    idleClean = false;
+    busCycle = 2; // two internal reads of PC before the pushes
     push16(PC);
-    push((status.value & ~0x30) | 0x20);
+    push((status.to_byte() & ~0x30) | 0x20);
     status.i = 1;
     PC = read16(0xFFFA);
     cycles = 8;
@@ -412,26 +486,49 @@ void CPU6502::irq()
 {
     if (status.i == 0)
     {
+        idleClean = false;
+        busCycle = 2;
         push16(PC);
-        push((status.value & ~0x30) | 0x20);
+        push((status.to_byte() & ~0x30) | 0x20);
         status.i = 1;
         PC = read16(0xFFFE);
         cycles = 7;
     }
 }
 
-void CPU6502::serialize(std::ostream &os) const
+void CPU6502::saveState(StateWriter &out) const
 {
-    auto begin = reinterpret_cast<const char *>(this) + offsetof(CPU6502, PC);
-    auto end = reinterpret_cast<const char *>(this) + offsetof(CPU6502, bus);
-    os.write(begin, end - begin);
+    Status p = status;
+    out.put(PC);
+    out.put(A);
+    out.put(X);
+    out.put(Y);
+    out.put(SP);
+    out.put(p.to_byte());
+    out.put(cycles);
+    out.put(totalcycles);
 }
 
-void CPU6502::deserialize(std::istream &is)
+void CPU6502::loadState(StateReader &in)
 {
-    auto begin = reinterpret_cast<char *>(this) + offsetof(CPU6502, PC);
-    auto end = reinterpret_cast<char *>(this) + offsetof(CPU6502, bus);
-    is.read(begin, end - begin);
+    uint8_t p;
+    in.get(PC);
+    in.get(A);
+    in.get(X);
+    in.get(Y);
+    in.get(SP);
+    in.get(p);
+    in.get(cycles);
+    in.get(totalcycles);
+    status.from_byte(p);
+
+    busCycle = 0;
+    for (auto &g : ramGen)
+        g++;
+    curBlock = nullptr;
+    idleClean = false;
+    idleLastPass = 0;
+    idleLoopCycles = 0;
 }
 
 void CPU6502::setPc(std::uint16_t newPc)
@@ -444,37 +541,138 @@ bool CPU6502::isCrossed(uint16_t A, int16_t b)
     return (A & 0xFF00) != (b & 0xFF00);
 }
 
-void CPU6502::execute()
+const CPU6502::DecodedOp *CPU6502::fetchOp()
+{
+    // Code in the I/O range is never cached: decoding it would read registers
+    if (PC >= 0x2000 && PC <= 0x401F)
+        return nullptr;
+
+    uint32_t gen = codeGen(PC);
+    if (curBlock && PC == curPC && curIndex < curBlock->length && curBlock->gen == gen)
+    {
+        const DecodedOp *op = &curBlock->ops[curIndex++];
+        curPC += op->length;
+        return op;
+    }
+
+    if (blocks.empty())
+        blocks.resize(BLOCK_SLOTS);
+
+    CodeBlock &block = blocks[(PC ^ (PC >> 9)) & (BLOCK_SLOTS - 1)];
+    if (block.pc != PC || block.gen != gen)
+        decodeBlock(block, PC);
+
+    if (useRecompiler && PC >= 0x8000 && ++block.hits == HOT_BLOCK_HITS)
+        compileBlock(block);
+
+    curBlock = nullptr;
+    if (block.length == 0)
+        return nullptr;
+
+    curBlock = &block;
+    curIndex = 1;
+    curPC = PC + block.ops[0].length;
+    return &block.ops[0];
+}
+
+void CPU6502::decodeOp(uint16_t pc, DecodedOp &op)
+{
+    op.opcode = fetch(pc);
+    op.length = instrLength(lookup[op.opcode].addressing);
+    op.lo = op.length > 1 ? fetch(pc + 1) : 0;
+    op.hi = op.length > 2 ? fetch(pc + 2) : 0;
+}
+
+void CPU6502::decodeBlock(CodeBlock &block, uint16_t pc)
+{
+    // A block runs until a control transfer, the end of its 256-byte page or
+    // MAX_BLOCK_OPS instructions, so one generation counter covers all of it.
+    block.pc = pc;
+    block.gen = codeGen(pc);
+    block.length = 0;
+    block.hits = 0;
+
+    uint16_t addr = pc;
+    while (block.length < MAX_BLOCK_OPS)
+    {
+        uint8_t opcode = fetch(addr);
+        uint8_t len = instrLength(lookup[opcode].addressing);
+        if (((addr + len - 1) & 0xFF00) != (pc & 0xFF00))
+            break;
+
+        DecodedOp &op = block.ops[block.length++];
+        decodeOp(addr, op);
+        addr += len;
+        if (endsBlock(opcode))
+            break;
+    }
+}
+
+bool CPU6502::endsBlock(uint8_t opcode)
+{
+    switch (opcode)
+    {
+    case 0x00: // BRK
+    case 0x20: // JSR
+    case 0x40: // RTI
+    case 0x4C: // JMP abs
+    case 0x60: // RTS
+    case 0x6C: // JMP ind
+        return true;
+    default:
+        return lookup[opcode].addressing == Addressing::REL;
+    }
+}
+
+const char *CPU6502::addressingName(Addressing mode)
+{
+    static const char *const names[ADDRESSING_MODES] = {"IMP", "ACC", "IMM", "ZP0", "ZPX", "ZPY", "REL",
+                                                        "ABS", "ABX", "ABY", "IND", "IZX", "IZY"};
+    return names[static_cast<int>(mode)];
+}
+
+void CPU6502::flushDecodeCache()
+{
+    for (auto &g : ramGen)
+        g++;
+    romGen++;
+    curBlock = nullptr;
+}
+
+// On AccurateBus the dummy reads happen here: indexed zero page reads the base,
+// and indexed absolute reads the unfixed address on a page cross (always for
+// writes, which can't skip it).
+uint16_t CPU6502::resolveAddress(Addressing mode, uint16_t operand, bool &pageCrossed, bool writes)
 {
-    uint8_t opcode = read(PC++);
     uint16_t address = 0;
-    bool pageCrossed = false;
-    const instruction &ins = lookup[opcode];
+    pageCrossed = false;
 
-    switch (ins.addressing)
+    switch (mode)
     {
     case Addressing::IMP: // Implied
     case Addressing::ACC: // Accumulator
         break;
 
     case Addressing::IMM: // Immediate
-        address = PC++;
+        address = PC - 1;
         break;
 
     case Addressing::ZP0: // Zero Page
-        address = read(PC++) & 0x00FF;
+        address = operand & 0x00FF;
         break;
 
     case Addressing::ZPX: // Zero Page,X
-        address = (read(PC++) + X) & 0x00FF;
+        dummyRead(operand & 0x00FF);
+        address = (operand + X) & 0x00FF;
         break;
 
     case Addressing::ZPY: // Zero Page,Y
-        address = (read(PC++) + Y) & 0x00FF;
+        dummyRead(operand & 0x00FF);
+        address = (operand + Y) & 0x00FF;
         break;
 
     case Addressing::REL: // Relative
-        address = read(PC++);
+        address = operand & 0x00FF;
         if (address & 0x80) // Sign extend if negative
         {
             address |= 0xFF00;
@@ -482,32 +680,26 @@ void CPU6502::execute()
         break;
 
     case Addressing::ABS: // Absolute
-        address = read16(PC);
-        PC += 2;
+        address = operand;
         break;
 
     case Addressing::ABX: // Absolute,X
-    {
-        uint16_t base = read16(PC);
-        address = base + X;
-        PC += 2;
-        pageCrossed = isCrossed(base, address);
-    }
-    break;
+        address = operand + X;
+        pageCrossed = isCrossed(operand, address);
+        if (pageCrossed || writes)
+            dummyRead((operand & 0xFF00) | (address & 0x00FF));
+        break;
 
     case Addressing::ABY: // Absolute,Y
-    {
-        uint16_t base = read16(PC);
-        address = base + Y;
-        PC += 2;
-        pageCrossed = isCrossed(base, address);
-    }
-    break;
+        address = operand + Y;
+        pageCrossed = isCrossed(operand, address);
+        if (pageCrossed || writes)
+            dummyRead((operand & 0xFF00) | (address & 0x00FF));
+        break;
 
     case Addressing::IND: // Indirect
     {
-        uint16_t ptr = read16(PC);
-        PC += 2;
+        uint16_t ptr = operand;
 
         // Simulate 6502 page boundary hardware bug
         if ((ptr & 0x00FF) == 0x00FF)
@@ -526,7 +718,8 @@ void CPU6502::execute()
 
     case Addressing::IZX: // (Indirect,X)
     {
-        uint8_t temp = read(PC++);
+        uint8_t temp = operand & 0x00FF;
+        dummyRead(temp);
         uint8_t lo = read((temp + X) & 0x00FF);
         uint8_t hi = read((temp + X + 1) & 0x00FF);
         address = (hi << 8) | lo;
@@ -535,64 +728,183 @@ void CPU6502::execute()
 
     case Addressing::IZY: // (Indirect),Y
     {
-        uint8_t temp = read(PC++);
+        uint8_t temp = operand & 0x00FF;
         uint8_t lo = read(temp & 0x00FF);
         uint8_t hi = read((temp + 1) & 0x00FF);
         uint16_t base = (hi << 8) | lo;
         address = base + Y;
         pageCrossed = isCrossed(base, address);
+        if (pageCrossed || writes)
+            dummyRead((base & 0xFF00) | (address & 0x00FF));
     }
     break;
     }
-    if (opcode == 0x0A) // ASL A
+    return address;
+}
+
+// Stores and read-modify-writes: indexed modes always take their dummy read
+static const std::array<bool, 256> storeOps = []
+{
+    std::array<bool, 256> table{};
+    for (int op = 0; op < 256; op++)
+        table[op] = CPU6502::writesMemory(op);
+    return table;
+}();
+
+void CPU6502::execute()
+{
+    DecodedOp local;
+    const DecodedOp *op = useDecodeCache ? fetchOp() : nullptr;
+    if (!op)
     {
-        status.c = (A >> 7) & 1;
-        A <<= 1;
-        status.z = (A == 0 ? 1 : 0);
-        status.n = (((A >> 7) & 1) == 1 ? 1 : 0);
+        decodeOp(PC, local);
+        op = &local;
     }
-    else if (opcode == 0x2A) // ROL A
+
+    if (trace)
+        traceOp(*op);
+
+    const instruction &ins = lookup[op->opcode];
+    bool pageCrossed;
+    uint16_t opPC = PC;
+    PC += op->length;
+    bool writes = false;
+    if constexpr (Accuracy::cycleAccurate)
     {
-        uint8_t oldC = status.c;
-        status.c = (A >> 7) & 1;
-        A = (A << 1) | oldC;
-        status.z = (A == 0 ? 1 : 0);
-        status.n = (((A >> 7) & 1) == 1 ? 1 : 0);
+        // Program bytes were fetched up front; one-byte opcodes also read the
+        // next byte and throw it away. Immediate operands are read by the
+        // handler itself.
+        busCycle = op->length + (op->length == 1) - (ins.addressing == Addressing::IMM);
+        writes = storeOps[op->opcode];
     }
-    else if (opcode == 0x4A) // LSR A
+    uint16_t address = resolveAddress(ins.addressing, op->lo | (op->hi << 8), pageCrossed, writes);
+
+    (this->*(ins.operate))(address);
+    cycles += ins.cycle;
+    if (pageCrossed && ins.pagePenalty)
     {
-        status.c = A & 1;
-        A >>= 1;
-        status.z = (A == 0 ? 1 : 0);
-        status.n = (((A >> 7) & 1) == 1 ? 1 : 0);
+        cycles += 1;
     }
-    else if (opcode == 0x6A) // ROR A
+    totalcycles += cycles;
+
+    if constexpr (Profiler::enabled)
+        profiler.record(opPC, op->opcode, cycles);
+    if (detectIdleLoops)
+        trackIdle(opPC, op->opcode, address);
+}
+
+void CPU6502::traceOp(const DecodedOp &op)
+{
+    bus->syncPPU(); // only so the recorded scanline/dot are current
+    TraceRecord r{};
+    r.cycle = totalcycles;
+    r.pc = PC;
+    r.dot = bus->ppu.dot;
+    r.scanline = bus->ppu.scanline_cycle;
+    r.opcode = op.opcode;
+    r.lo = op.length > 1 ? op.lo : 0;
+    r.hi = op.length > 2 ? op.hi : 0;
+    r.a = A;
+    r.x = X;
+    r.y = Y;
+    r.p = status.to_byte();
+    r.sp = SP;
+    trace->push(r);
+}
+
+// Opcodes that can appear in an idle loop: no writes, no stack, no I flag
+static const std::array<bool, 256> idleSafe = []
+{
+    using C = CPU6502;
+    static const C::InstrFn safe[] = {
+        &C::LDA, &C::LDX, &C::LDY, &C::LAX, &C::CMP, &C::CPX, &C::CPY, &C::BIT,
+        &C::AND, &C::ORA, &C::EOR, &C::ADC, &C::SBC, &C::TAX, &C::TAY, &C::TXA,
+        &C::TYA, &C::TSX, &C::INX, &C::INY, &C::DEX, &C::DEY, &C::CLC, &C::SEC,
+        &C::CLV, &C::CLD, &C::NOP, &C::IGN, &C::BCC, &C::BCS, &C::BEQ, &C::BMI,
+        &C::BNE, &C::BPL, &C::BVC, &C::BVS};
+    std::array<bool, 256> table{};
+    for (int op = 0; op < 256; op++)
     {
-        uint8_t oldC = status.c;
-        status.c = A & 1;
-        A = (A >> 1) | (oldC << 7);
-        status.z = (A == 0 ? 1 : 0);
-        status.n = (((A >> 7) & 1) == 1 ? 1 : 0);
+        for (C::InstrFn fn : safe)
+            table[op] = table[op] || C::lookup[op].operate == fn;
     }
-    else if (opcode == 0x0B || opcode == 0x2B)
+    table[0x4C] = true; // JMP abs
+    return table;
+}();
+
+void CPU6502::trackIdle(uint16_t opPC, uint8_t opcode, uint16_t address)
+{
+    if (!idleSafe[opcode])
+    {
+        idleClean = false;
+        return;
+    }
+
+    Addressing mode = lookup[opcode].addressing;
+    bool readsMemory = mode != Addressing::IMP && mode != Addressing::ACC &&
+                       mode != Addressing::REL && opcode != 0x4C;
+    // Only pages the Bus maps straight to RAM or ROM read without side
+    // effects; I/O, mapper registers and anything else unmapped may not
+    if (readsMemory && !bus->readPage[address >> 8])
     {
-        uint8_t m = read(address);
-        A = A & m;
-        status.z = (A == 0 ? 1 : 0);
-        status.n = ((A & 0x80) != 0 ? 1 : 0);
-        status.c = status.n;
+        if (address >= 0x2000 && address <= 0x3FFF && (address & 0x0007) == 0x0002)
+            idlePassReadsPPU = true; // PPUSTATUS: Bus checks it can't change
+        else
+            idleClean = false;
+    }
+
+    if (PC <= opPC)
+        loopHead();
+}
+
+bool CPU6502::idleSafeOp(uint8_t opcode)
+{
+    return idleSafe[opcode];
+}
+
+void CPU6502::loopHead()
+{
+    uint8_t regs[5] = {A, X, Y, SP, status.to_byte()};
+    if (PC == idleHead && idleClean && memcmp(regs, idleRegs, sizeof(regs)) == 0)
+    {
+        // A $2002 read can clear vblank, so the pass that did so may differ
+        // from the ones after it: wait for a second identical pass.
+        uint32_t pass = uint32_t(totalcycles - idleStart);
+        if (!idlePassReadsPPU || pass == idleLastPass)
+        {
+            idleLoopCycles = pass;
+            idleReadsPPU = idlePassReadsPPU;
+        }
+        idleLastPass = pass;
     }
     else
     {
-        (this->*(ins.operate))(address);
+        idleLastPass = 0;
     }
-    status.to_byte();
-    cycles += ins.cycle;
-    if (pageCrossed && checkpagecross.find(opcode) != checkpagecross.end() && !(opcode >= 0x10 && opcode <= 0x70 && (opcode & 0x1F) == 0x10))
+    idleHead = PC;
+    idleStart = totalcycles;
+    memcpy(idleRegs, regs, sizeof(regs));
+    idleClean = true;
+    idlePassReadsPPU = false;
+}
+
+bool CPU6502::writesMemory(uint8_t opcode)
+{
+    const instruction &ins = lookup[opcode];
+    if (ins.addressing == Addressing::IMP || ins.addressing == Addressing::ACC)
+        return false;
+
+    static const InstrFn writers[] = {
+        &CPU6502::STA, &CPU6502::STX, &CPU6502::STY, &CPU6502::SAX, &CPU6502::AHX,
+        &CPU6502::SHX, &CPU6502::TAS, &CPU6502::ASL, &CPU6502::LSR, &CPU6502::ROL,
+        &CPU6502::ROR, &CPU6502::INC, &CPU6502::DEC, &CPU6502::SLO, &CPU6502::RLA,
+        &CPU6502::SRE, &CPU6502::RRA, &CPU6502::DCP, &CPU6502::ISC};
+    for (InstrFn fn : writers)
     {
-        cycles += 1;
+        if (ins.operate == fn)
+            return true;
     }
-    totalcycles += cycles;
+    return false;
 }
 
 std::string CPU6502::debugStr()
@@ -603,14 +915,14 @@ std::string CPU6502::debugStr()
     }
 
     std::ostringstream os;
-    std::uint8_t nextOpcode = read(PC);
+    std::uint8_t nextOpcode = fetch(PC);
 
     os << std::hex << std::uppercase << std::right << std::setfill('0');
     os << std::setw(4) << PC << "  " << std::setw(2) << +nextOpcode << " " << CPU6502::lookup[nextOpcode].opcodename << "         ";
     os << " A:" << std::setw(2) << +A
        << " X:" << std::setw(2) << +X
        << " Y:" << std::setw(2) << +Y
-       << " P:" << std::setw(2) << +status.value
+       << " P:" << std::setw(2) << +status.to_byte()
        << " SP:" << std::setw(2) << +SP
        << " CYC:" << std::dec << totalcycles;
     os << "\n";
@@ -623,27 +935,24 @@ void CPU6502::ADC(uint16_t address)
     uint8_t m = read(address);
     uint16_t temp = uint16_t(A) + uint16_t(m) + uint16_t(status.c);
     status.c = (temp > 0xFF ? 1 : 0);
-    status.v = (~(A ^ m) & (A ^ temp) & 0x80 ? 1 : 0);
+    status.vres = ~(A ^ m) & (A ^ temp);
     A = uint8_t(temp);
-    status.z = (A == 0 ? 1 : 0);
-    status.n = (A & 0x80 ? 1 : 0);
+    status.setNZ(A);
 }
 
 void CPU6502::AND(uint16_t address)
 {
     A = A & read(address);
-    status.z = (A == 0 ? 1 : 0);
-    status.n = ((A & 0x80) != 0 ? 1 : 0);
+    status.setNZ(A);
 }
 
 void CPU6502::ASL(uint16_t address)
 {
-    uint8_t m = read(address);
+    uint8_t m = readModify(address);
     status.c = (m & 0x80) >> 7;
     m <<= 1;
     write(address, m);
-    status.z = (m == 0 ? 1 : 0);
-    status.n = ((m & 0x80) != 0 ? 1 : 0);
+    status.setNZ(m);
 }
 
 void CPU6502::BCC(uint16_t address)
@@ -677,7 +986,7 @@ void CPU6502::BCS(uint16_t address)
 
 void CPU6502::BEQ(uint16_t address)
 {
-    if (status.z)
+    if (status.Z())
     {
         uint16_t old_pc = PC;
         PC += static_cast<int8_t>(address);
@@ -692,14 +1001,14 @@ void CPU6502::BEQ(uint16_t address)
 void CPU6502::BIT(uint16_t address)
 {
     uint8_t m = read(address);
-    status.z = ((m & A) == 0 ? 1 : 0);
-    status.v = ((m & 0x40) != 0 ? 1 : 0);
-    status.n = ((m & 0x80) != 0 ? 1 : 0);
+    status.zres = m & A;
+    status.vres = m << 1;
+    status.nres = m;
 }
 
 void CPU6502::BMI(uint16_t address)
 {
-    if (status.n)
+    if (status.N())
     {
         uint16_t old_pc = PC;
         PC += static_cast<int8_t>(address);
@@ -714,7 +1023,7 @@ void CPU6502::BMI(uint16_t address)
 
 void CPU6502::BNE(uint16_t address)
 {
-    if (!status.z)
+    if (!status.Z())
     {
         uint16_t old_pc = PC;
         PC += static_cast<int8_t>(address);
@@ -729,7 +1038,7 @@ void CPU6502::BNE(uint16_t address)
 
 void CPU6502::BPL(uint16_t address)
 {
-    if (!status.n)
+    if (!status.N())
     {
         uint16_t old_pc = PC;
         PC += static_cast<int8_t>(address);
@@ -745,13 +1054,13 @@ void CPU6502::BPL(uint16_t address)
 void CPU6502::BRK(uint16_t address)
 {
     push16(PC);
-    status.i = 1;
     PHP(address);
+    status.i = 1;
     PC = read16(0xFFFE);
 }
 void CPU6502::BVC(uint16_t address)
 {
-    if (!status.v)
+    if (!status.V())
     {
         uint16_t old_pc = PC;
         PC += static_cast<int8_t>(address);
@@ -766,7 +1075,7 @@ void CPU6502::BVC(uint16_t address)
 
 void CPU6502::BVS(uint16_t address)
 {
-    if (status.v)
+    if (status.V())
     {
         uint16_t old_pc = PC;
         PC += static_cast<int8_t>(address);
@@ -796,7 +1105,7 @@ void CPU6502::CLI(uint16_t)
 
 void CPU6502::CLV(uint16_t)
 {
-    status.v = 0;
+    status.vres = 0;
 }
 
 void CPU6502::CMP(uint16_t address)
@@ -805,8 +1114,7 @@ void CPU6502::CMP(uint16_t address)
     uint8_t result = A - m;
 
     status.c = (A >= m ? 1 : 0);
-    status.z = (A == m ? 1 : 0);
-    status.n = ((result & 0x80) != 0 ? 1 : 0);
+    status.setNZ(result);
 }
 
 void CPU6502::CPX(uint16_t address)
@@ -815,8 +1123,7 @@ void CPU6502::CPX(uint16_t address)
     uint8_t result = X - m;
 
     status.c = (X >= m ? 1 : 0);
-    status.z = (X == m ? 1 : 0);
-    status.n = ((result & 0x80) != 0 ? 1 : 0);
+    status.setNZ(result);
 }
 
 void CPU6502::CPY(uint16_t address)
@@ -825,63 +1132,55 @@ void CPU6502::CPY(uint16_t address)
     uint8_t result = Y - m;
 
     status.c = (Y >= m ? 1 : 0);
-    status.z = (Y == m ? 1 : 0);
-    status.n = ((result & 0x80) != 0 ? 1 : 0);
+    status.setNZ(result);
 }
 
 void CPU6502::DEC(uint16_t address)
 {
-    uint8_t m = read(address);
+    uint8_t m = readModify(address);
     m--;
     write(address, m);
 
-    status.z = (m == 0 ? 1 : 0);
-    status.n = ((m & 0x80) != 0 ? 1 : 0);
+    status.setNZ(m);
 }
 
 void CPU6502::DEX(uint16_t)
 {
     X--;
-    status.z = (X == 0 ? 1 : 0);
-    status.n = ((X & 0x80) != 0 ? 1 : 0);
+    status.setNZ(X);
 }
 
 void CPU6502::DEY(uint16_t)
 {
     Y--;
-    status.z = (Y == 0 ? 1 : 0);
-    status.n = ((Y & 0x80) != 0 ? 1 : 0);
+    status.setNZ(Y);
 }
 
 void CPU6502::EOR(uint16_t address)
 {
     A = A ^ read(address);
-    status.z = (A == 0 ? 1 : 0);
-    status.n = ((A & 0x80) != 0 ? 1 : 0);
+    status.setNZ(A);
 }
 
 void CPU6502::INC(uint16_t address)
 {
-    uint8_t m = read(address);
+    uint8_t m = readModify(address);
     m++;
     write(address, m);
 
-    status.z = (m == 0 ? 1 : 0);
-    status.n = ((m & 0x80) != 0 ? 1 : 0);
+    status.setNZ(m);
 }
 
 void CPU6502::INX(uint16_t)
 {
     X++;
-    status.z = (X == 0 ? 1 : 0);
-    status.n = ((X & 0x80) != 0 ? 1 : 0);
+    status.setNZ(X);
 }
 
 void CPU6502::INY(uint16_t)
 {
     Y++;
-    status.z = (Y == 0 ? 1 : 0);
-    status.n = ((Y & 0x80) != 0 ? 1 : 0);
+    status.setNZ(Y);
 }
 
 void CPU6502::JMP(uint16_t address)
@@ -898,43 +1197,44 @@ void CPU6502::JSR(uint16_t address)
 void CPU6502::LDA(uint16_t address)
 {
     A = read(address);
-    status.z = (A == 0 ? 1 : 0);
-    status.n = ((A & 0x80) != 0 ? 1 : 0);
+    status.setNZ(A);
 }
 
 void CPU6502::LDX(uint16_t address)
 {
     X = read(address);
-    status.z = (X == 0 ? 1 : 0);
-    status.n = ((X & 0x80) != 0 ? 1 : 0);
+    status.setNZ(X);
 }
 
 void CPU6502::LDY(uint16_t address)
 {
     Y = read(address);
-    status.z = (Y == 0 ? 1 : 0);
-    status.n = ((Y & 0x80) != 0 ? 1 : 0);
+    status.setNZ(Y);
 }
 
 void CPU6502::LSR(uint16_t address)
 {
-    uint8_t m = read(address);
+    uint8_t m = readModify(address);
     status.c = m & 1;
     m >>= 1;
     write(address, m);
-    status.z = (m == 0 ? 1 : 0);
-    status.n = 0;
+    status.setNZ(m);
 }
 
 void CPU6502::NOP(uint16_t)
 {
 }
 
+// Unofficial NOPs with an operand still read it
+void CPU6502::IGN(uint16_t address)
+{
+    dummyRead(address);
+}
+
 void CPU6502::ORA(uint16_t address)
 {
     A = A | read(address);
-    status.z = (A == 0 ? 1 : 0);
-    status.n = ((A & 0x80) != 0 ? 1 : 0);
+    status.setNZ(A);
 }
 
 void CPU6502::PHA(uint16_t)
@@ -945,49 +1245,44 @@ void CPU6502::PHA(uint16_t)
 void CPU6502::PHP(uint16_t)
 {
 
-    push(status.value | 0x30);
+    push(status.to_byte() | 0x30);
 }
 
 void CPU6502::PLA(uint16_t)
 {
     A = pop();
-    status.z = (A == 0 ? 1 : 0);
-    status.n = ((A & 0x80) != 0 ? 1 : 0);
+    status.setNZ(A);
 }
 
 void CPU6502::PLP(uint16_t)
 {
-    status.value = (pop() & 0xEF) | 0x20;
-    status.from_byte(status.value);
+    status.from_byte((pop() & 0xEF) | 0x20);
 }
 
 void CPU6502::ROL(uint16_t address)
 {
-    uint8_t m = read(address);
+    uint8_t m = readModify(address);
     uint8_t oldC = status.c;
     status.c = (m & 0x80) >> 7;
     m = (m << 1) | oldC;
     write(address, m);
-    status.z = (m == 0 ? 1 : 0);
-    status.n = ((m & 0x80) != 0 ? 1 : 0);
+    status.setNZ(m);
 }
 
 void CPU6502::ROR(uint16_t address)
 {
-    uint8_t m = read(address);
+    uint8_t m = readModify(address);
     uint8_t oldC = status.c;
     status.c = m & 1;
     m = (m >> 1) | (oldC << 7);
     write(address, m);
-    status.z = (m == 0 ? 1 : 0);
-    status.n = ((m & 0x80) != 0 ? 1 : 0);
+    status.setNZ(m);
 }
 
 void CPU6502::RTI(uint16_t)
 {
 
-    status.value = (pop() & 0xEF) | 0x20;
-    status.from_byte(status.value);
+    status.from_byte((pop() & 0xEF) | 0x20);
     PC = pop16();
 }
 
@@ -1002,11 +1297,10 @@ void CPU6502::SBC(uint16_t address)
     uint16_t diff = uint16_t(A) - m - (1 - status.c);
 
     status.c = (diff <= 0xFF ? 1 : 0); // Carry clear on borrow
-    status.v = ((A ^ diff) & (~m ^ diff) & 0x80 ? 1 : 0);
+    status.vres = (A ^ diff) & (~m ^ diff);
 
     A = uint8_t(diff);
-    status.z = (A == 0 ? 1 : 0);
-    status.n = ((A & 0x80) != 0 ? 1 : 0);
+    status.setNZ(A);
 }
 
 void CPU6502::SEC(uint16_t)
@@ -1042,29 +1336,25 @@ void CPU6502::STY(uint16_t address)
 void CPU6502::TAX(uint16_t)
 {
     X = A;
-    status.z = (X == 0 ? 1 : 0);
-    status.n = ((X & 0x80) != 0 ? 1 : 0);
+    status.setNZ(X);
 }
 
 void CPU6502::TAY(uint16_t)
 {
     Y = A;
-    status.z = (Y == 0 ? 1 : 0);
-    status.n = ((Y & 0x80) != 0 ? 1 : 0);
+    status.setNZ(Y);
 }
 
 void CPU6502::TSX(uint16_t)
 {
     X = SP;
-    status.z = (X == 0 ? 1 : 0);
-    status.n = ((X & 0x80) != 0 ? 1 : 0);
+    status.setNZ(X);
 }
 
 void CPU6502::TXA(uint16_t)
 {
     A = X;
-    status.z = (A == 0 ? 1 : 0);
-    status.n = ((A & 0x80) != 0 ? 1 : 0);
+    status.setNZ(A);
 }
 
 void CPU6502::TXS(uint16_t)
@@ -1075,8 +1365,7 @@ void CPU6502::TXS(uint16_t)
 void CPU6502::TYA(uint16_t)
 {
     A = Y;
-    status.z = (A == 0 ? 1 : 0);
-    status.n = ((A & 0x80) != 0 ? 1 : 0);
+    status.setNZ(A);
 }
 
 void CPU6502::XXX(uint16_t)
@@ -1101,7 +1390,7 @@ void CPU6502::SHX(uint16_t address)
 void CPU6502::SAX(uint16_t address)
 {
     uint8_t value = A & X;
-    bus->CPUwrite(address, value);
+    write(address, value);
 }
 
 void CPU6502::KIL(uint16_t /*address*/)
@@ -1120,8 +1409,7 @@ void CPU6502::LAS(uint16_t address)
 {
     uint8_t value = read(address) & SP;
     A = X = SP = value;
-    status.z = (value == 0 ? 1 : 0);
-    status.n = ((value & 0x80) != 0 ? 1 : 0);
+    status.setNZ(value);
 }
 
 void CPU6502::AXS(uint16_t address)
@@ -1130,41 +1418,37 @@ void CPU6502::AXS(uint16_t address)
     uint8_t temp = (A & X) - m;
     status.c = ((A & X) >= m) ? 1 : 0;
     X = temp;
-    status.z = (X == 0 ? 1 : 0);
-    status.n = ((X & 0x80) != 0 ? 1 : 0);
+    status.setNZ(X);
 }
 
 void CPU6502::SLO(uint16_t address)
 {
-    uint8_t m = read(address);
+    uint8_t m = readModify(address);
     uint8_t result = m << 1;
     status.c = (m & 0x80) != 0;
     write(address, result);
     A |= result;
-    status.z = (A == 0);
-    status.n = (A & 0x80) != 0;
+    status.setNZ(A);
 }
 
 void CPU6502::RLA(uint16_t address)
 {
-    uint8_t m = read(address);
+    uint8_t m = readModify(address);
     uint8_t result = (m << 1) | status.c;
     status.c = (m & 0x80) != 0;
     write(address, result);
     A &= result;
-    status.z = (A == 0);
-    status.n = (A & 0x80) != 0;
+    status.setNZ(A);
 }
 
 void CPU6502::SRE(uint16_t address)
 {
-    uint8_t m = read(address);
+    uint8_t m = readModify(address);
     status.c = (m & 0x01) != 0;
     uint8_t result = m >> 1;
     write(address, result);
     A ^= result;
-    status.z = (A == 0);
-    status.n = (A & 0x80) != 0;
+    status.setNZ(A);
 }
 
 void CPU6502::ALR(uint16_t address)
@@ -1173,23 +1457,21 @@ void CPU6502::ALR(uint16_t address)
     uint8_t anded = A & m;
     status.c = (anded & 0x01) != 0;
     A = anded >> 1;
-    status.z = (A == 0);
-    status.n = (A & 0x80) != 0;
+    status.setNZ(A);
 }
 
 void CPU6502::RRA(uint16_t address)
 {
-    uint8_t m = read(address);
+    uint8_t m = readModify(address);
     uint8_t rotated = (m >> 1) | (status.c << 7);
     status.c = (m & 0x01) != 0;
     write(address, rotated);
 
     uint16_t temp = uint16_t(A) + uint16_t(rotated) + uint16_t(status.c);
     status.c = (temp > 0xFF);
-    status.v = (~(A ^ rotated) & (A ^ temp) & 0x80) != 0;
+    status.vres = ~(A ^ rotated) & (A ^ temp);
     A = uint8_t(temp);
-    status.z = (A == 0);
-    status.n = (A & 0x80) != 0;
+    status.setNZ(A);
 }
 
 void CPU6502::ARR(uint16_t address)
@@ -1199,9 +1481,8 @@ void CPU6502::ARR(uint16_t address)
     uint8_t oldA = A;
     A = (A >> 1) | (status.c << 7);
     status.c = (A & 0x40) >> 6;
-    status.v = ((A >> 5) ^ (A >> 6)) & 1;
-    status.z = (A == 0);
-    status.n = (A & 0x80) != 0;
+    status.vres = (A << 1) ^ (A << 2); // bit 6 xor bit 5
+    status.setNZ(A);
 }
 
 void CPU6502::XAA(uint16_t address)
@@ -1213,8 +1494,7 @@ void CPU6502::XAA(uint16_t address)
     if (temp & 0x01 == 0)
         temp &= 0xFE;
     A = temp;
-    status.z = (A == 0);
-    status.n = (A & 0x80) != 0;
+    status.setNZ(A);
 }
 
 void CPU6502::LAX(uint16_t address)
@@ -1222,35 +1502,67 @@ void CPU6502::LAX(uint16_t address)
     uint8_t m = read(address);
     A = m;
     X = m;
-    status.z = (A == 0);
-    status.n = (A & 0x80) != 0;
+    status.setNZ(A);
 }
 
 void CPU6502::DCP(uint16_t address)
 {
-    uint8_t m = read(address) - 1;
+    uint8_t m = readModify(address) - 1;
     write(address, m);
 
     uint16_t temp = uint16_t(A) - uint16_t(m);
     status.c = (A >= m);
-    status.z = (temp == 0);
-    status.n = (temp & 0x80) != 0;
+    status.setNZ(uint8_t(temp));
 }
 
 void CPU6502::ISC(uint16_t address)
 {
-    uint8_t m = read(address) + 1;
+    uint8_t m = readModify(address) + 1;
     write(address, m);
 
     uint16_t temp = uint16_t(A) - uint16_t(m) - (1 - status.c);
     status.c = (A >= (m + (1 - status.c)));
-    status.v = ((A ^ temp) & (~m ^ temp) & 0x80) != 0;
+    status.vres = (A ^ temp) & (~m ^ temp);
     A = uint8_t(temp);
-    status.z = (A == 0);
-    status.n = (A & 0x80) != 0;
+    status.setNZ(A);
 }
 
 void CPU6502::ANC(uint16_t address)
 {
-    // Already Implemented
-}
\ No newline at end of file
+    uint8_t m = read(address);
+    A = A & m;
+    status.setNZ(A);
+    status.c = A >> 7;
+}
+
+// Accumulator forms of the shifts
+
+void CPU6502::ASL_A(uint16_t)
+{
+    status.c = (A >> 7) & 1;
+    A <<= 1;
+    status.setNZ(A);
+}
+
+void CPU6502::ROL_A(uint16_t)
+{
+    uint8_t oldC = status.c;
+    status.c = (A >> 7) & 1;
+    A = (A << 1) | oldC;
+    status.setNZ(A);
+}
+
+void CPU6502::LSR_A(uint16_t)
+{
+    status.c = A & 1;
+    A >>= 1;
+    status.setNZ(A);
+}
+
+void CPU6502::ROR_A(uint16_t)
+{
+    uint8_t oldC = status.c;
+    status.c = A & 1;
+    A = (A >> 1) | (oldC << 7);
+    status.setNZ(A);
+}
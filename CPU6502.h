@@ -2,11 +2,18 @@
 #include <string>
 #include <vector>
 #include <cstdint>
-#include <unordered_set>
+#include "BusPolicy.h"
+#include "CPUProfiler.h"
+#include "Recompiler.h"
+#include "Trace.h"
 using namespace std;
 
 class Bus;
+class StateWriter;
+class StateReader;
 
+inline namespace SIMPLENES_BUS_NAMESPACE
+{
 class CPU6502
 {
 public:
@@ -35,20 +42,23 @@ public:
         IZX,
         IZY,
     };
+    static constexpr int ADDRESSING_MODES = 13;
+    static const char *addressingName(Addressing mode);
 
     struct instruction
     {
-        string opcodename;
+        const char *opcodename;
         InstrFn operate;
         Addressing addressing;
-        int cycle;
-
-        instruction(string name, InstrFn op, Addressing addr, int cyc)
-            : opcodename(name), operate(op), addressing(addr), cycle(cyc) {}
+        uint8_t cycle;
+        bool pagePenalty = false; // +1 cycle on page cross (indexed reads)
     };
     uint8_t read(uint16_t addr);
     uint16_t read16(uint16_t addr);
     void write(uint16_t addr, uint8_t data);
+    uint8_t fetch(uint16_t addr);       // program bytes; execute() charges their cycles
+    void dummyRead(uint16_t addr);      // AccurateBus only
+    uint8_t readModify(uint16_t addr);  // RMW read, plus the dummy write on AccurateBus
     void push(uint8_t data);
     void push16(uint16_t data);
     uint8_t pop();
@@ -56,61 +66,170 @@ public:
 
     void connectBus(Bus* bus);
     void clock();
+    uint8_t step(); // run one whole instruction (or NMI), return its cycles
     void reset();
     void nmi();
     void irq();
+    bool pollInterrupts(bool nmiDue); // take a pending NMI or unmasked IRQ
+
+    // Decode cache. Instructions are decoded once into basic blocks keyed by
+    // start PC; a block is stale once the generation of the memory it came
+    // from moves on (RAM write to its page, or any mapper write for ROM).
+    struct DecodedOp
+    {
+        uint8_t opcode;
+        uint8_t lo;
+        uint8_t hi;
+        uint8_t length;
+    };
+    static constexpr int MAX_BLOCK_OPS = 16;
+    static constexpr int BLOCK_SLOTS = 512;
+    struct CodeBlock
+    {
+        uint16_t pc = 0;
+        uint32_t gen = 0; // 0 never matches a live generation
+        uint8_t length = 0;
+        uint16_t hits = 0;
+        DecodedOp ops[MAX_BLOCK_OPS];
+    };
+    bool useDecodeCache = true;
+    std::vector<CodeBlock> blocks; // allocated on first use
+    const CodeBlock *curBlock = nullptr;
+    uint8_t curIndex = 0;
+    uint16_t curPC = 0;
+    uint32_t ramGen[8] = {1, 1, 1, 1, 1, 1, 1, 1}; // per 256-byte page of internal RAM
+    uint32_t romGen = 1;                           // everything the cartridge maps
+
+    uint32_t codeGen(uint16_t addr) const { return addr < 0x2000 ? ramGen[(addr & 0x07FF) >> 8] : romGen; }
+    void ramWritten(uint16_t addr) { ramGen[(addr & 0x07FF) >> 8]++; }
+    void cartridgeWritten() { romGen++; }
+    void flushDecodeCache();
+    const DecodedOp *fetchOp();
+    void decodeOp(uint16_t pc, DecodedOp &op);
+    void decodeBlock(CodeBlock &block, uint16_t pc);
+    static bool endsBlock(uint8_t opcode);
+    static constexpr uint8_t instrLength(Addressing mode)
+    {
+        switch (mode)
+        {
+        case Addressing::IMP:
+        case Addressing::ACC:
+            return 1;
+        case Addressing::ABS:
+        case Addressing::ABX:
+        case Addressing::ABY:
+        case Addressing::IND:
+            return 3;
+        default:
+            return 2;
+        }
+    }
+
+    // Native recompiler (optional backend next to execute(), Recompiler.cpp).
+    // Once a ROM block has been entered HOT_BLOCK_HITS times it is translated
+    // into x86-64 code with operands, ROM reads and branch targets bound up
+    // front. runCompiled() chains through translated blocks within a cycle
+    // budget and hands back to the interpreter on I/O, cartridge writes,
+    // untranslated opcodes or code outside PRG ROM.
+    struct CompiledBlock
+    {
+        uint16_t pc = 0;
+        uint32_t gen = 0;
+        uint8_t length = 0;  // instructions translated, a prefix of the block
+        uint16_t lastPC = 0; // address of the last of them
+        bool idleSafe = false;
+        CodeArena::Entry code = nullptr;
+    };
+    static constexpr uint16_t HOT_BLOCK_HITS = 32;
+    bool useRecompiler = false;
+    std::vector<CompiledBlock> compiled; // allocated on first translation
+    CodeArena nativeCode;
+    uint8_t nativeOps = 0; // instructions the last native block completed
+    static bool writesMemory(uint8_t opcode);
+    void compileBlock(const CodeBlock &block);
+    void dropCompiled();
+    uint32_t runCompiled(uint32_t budget); // returns cycles run, 0 if nothing ran
+    bool irqDue() const;                   // an IRQ line is up and I is clear
+
+    // Idle-loop detection. A loop is idle when two consecutive passes through
+    // its head (the target of a backward branch/JMP) see identical registers
+    // and the pass only ran side-effect-free instructions reading $2002 or
+    // pages the Bus maps straight to RAM or ROM. Bus::step() then skips whole iterations up to the next PPU event.
+    bool detectIdleLoops = true;
+    uint16_t idleHead = 0;
+    uint64_t idleStart = 0;
+    uint8_t idleRegs[5] = {};
+    bool idleClean = false;
+    bool idlePassReadsPPU = false;
+    bool idleReadsPPU = false;   // the confirmed loop polls $2002
+    uint32_t idleLastPass = 0;   // length of the previous matching pass, 0 if none
+    uint32_t idleLoopCycles = 0; // cycles per iteration once a loop is confirmed
+    void trackIdle(uint16_t opPC, uint8_t opcode, uint16_t address);
+    void loopHead(); // PC was just reached by a backward transfer
+    static bool idleSafeOp(uint8_t opcode);
 
-    void serialize(std::ostream &os) const;
-    void deserialize(std::istream &is);
+    // Save state chunk. Loading drops code decoded from RAM and any idle-loop
+    // tracking, since RAM may have changed under them. ROM code is kept:
+    // Bus::loadState calls cartridgeWritten() if the load switched a bank.
+    void saveState(StateWriter &out) const;
+    void loadState(StateReader &in);
     bool isCrossed(uint16_t a, int16_t b);
     void setPc(std::uint16_t newPc);
+    uint16_t resolveAddress(Addressing mode, uint16_t operand, bool &pageCrossed, bool writes = false);
     void execute();
     std::string debugStr();
 
+    // Processor status with lazy N/Z/V. Handlers store the last result (and
+    // the overflow term) instead of packing bits; the flags are only worked
+    // out when a branch tests them or P is pushed/exported via to_byte().
     struct Status
     {
-        uint8_t value;
-        uint8_t c : 1; // Carry
-        uint8_t z : 1; // Zero
-        uint8_t i : 1; // Interrupt Disable
-        uint8_t d : 1; // Decimal Mode
-        uint8_t B : 1; // Break
-        uint8_t u : 1; // Unused (usually 1)
-        uint8_t v : 1; // Overflow
-        uint8_t n : 1; // Negative
-
-        Status(uint8_t val = 0) { from_byte(val); } 
+        uint8_t value; // packed P, valid after to_byte()
+        uint8_t c;     // Carry
+        uint8_t i;     // Interrupt Disable
+        uint8_t d;     // Decimal Mode
+        uint8_t B;     // Break
+        uint8_t u;     // Unused (usually 1)
+        uint8_t zres;  // Zero is set when zres == 0
+        uint8_t nres;  // Negative is bit 7 of nres
+        uint8_t vres;  // Overflow is bit 7 of vres
+
+        Status(uint8_t val = 0) { from_byte(val); }
+
+        bool Z() const { return zres == 0; }
+        bool N() const { return nres & 0x80; }
+        bool V() const { return vres & 0x80; }
+        void setNZ(uint8_t result) { zres = nres = result; }
 
         void from_byte(uint8_t val)
         {
             value = val;
             c = val & 0x01;
-            z = (val >> 1) & 0x01;
+            zres = (val & 0x02) ? 0 : 1;
             i = (val >> 2) & 0x01;
             d = (val >> 3) & 0x01;
             B = (val >> 4) & 0x01;
             u = (val >> 5) & 0x01;
-            v = (val >> 6) & 0x01;
-            n = (val >> 7) & 0x01;
+            vres = (val & 0x40) << 1;
+            nres = val & 0x80;
         }
 
         // Combine flags into byte
-        void to_byte()
+        uint8_t to_byte()
         {
             value = (c) |
-                    (z << 1) |
+                    (Z() << 1) |
                     (i << 2) |
                     (d << 3) |
                     (B << 4) |
                     (u << 5) |
-                    (v << 6) |
-                    (n << 7);
+                    (V() << 6) |
+                    (N() << 7);
+            return value;
         }
     };
 
-    vector<instruction> lookup;
-    unordered_set<uint8_t> checkpagecross;
-    CPU6502();
+    static const instruction lookup[256];
     void performDMA();
     void AcknowledgeNMI();
     void ADC(uint16_t address);
@@ -147,6 +266,7 @@ public:
     void LDY(uint16_t address);
     void LSR(uint16_t address);
     void NOP(uint16_t address);
+    void IGN(uint16_t address);
     void ORA(uint16_t address);
     void PHA(uint16_t address);
     void PHP(uint16_t address);
@@ -188,9 +308,36 @@ public:
     void LAX(uint16_t address);
     void DCP(uint16_t address);
     void ISC(uint16_t address);
+    void ASL_A(uint16_t address);
+    void ROL_A(uint16_t address);
+    void LSR_A(uint16_t address);
+    void ROR_A(uint16_t address);
+
+    // Execution profile, compiled in with SIMPLENES_PROFILE
+#ifdef SIMPLENES_PROFILE
+    using Profiler = CPUProfiler;
+#else
+    using Profiler = NullProfiler;
+#endif
+    Profiler profiler;
+
+    // Bus timing, compiled in with SIMPLENES_ACCURATE. Both policies run the
+    // same opcode handlers; only read/write and address resolution differ.
+#ifdef SIMPLENES_ACCURATE
+    using Accuracy = AccurateBus;
+#else
+    using Accuracy = FastBus;
+#endif
+    uint8_t busCycle = 0; // cycle of the next access within the instruction (AccurateBus)
+
+    // Binary trace of every interpreted instruction; off while null. The
+    // block translator is bypassed while a trace is attached.
+    TraceBuffer *trace = nullptr;
+    void traceOp(const DecodedOp &op);
 
     Bus* bus = nullptr;
     Status status{0x24};
     uint8_t cycles = 8;
-    int totalcycles = 8;
+    uint64_t totalcycles = 8;
 };
+}
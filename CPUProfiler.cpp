@@ -0,0 +1,123 @@
+#include "CPUProfiler.h"
+#include "CPU6502.h"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+
+namespace
+{
+    constexpr int MODES = CPU6502::ADDRESSING_MODES;
+
+    const char *modeName(int mode)
+    {
+        return CPU6502::addressingName(static_cast<CPU6502::Addressing>(mode));
+    }
+
+    struct ModeTotals
+    {
+        uint64_t count[MODES] = {};
+        uint64_t cycles[MODES] = {};
+    };
+
+    ModeTotals totalsByMode(const CPUProfiler &p)
+    {
+        ModeTotals t;
+        for (int op = 0; op < 256; op++)
+        {
+            int mode = static_cast<int>(CPU6502::lookup[op].addressing);
+            t.count[mode] += p.opCount[op];
+            t.cycles[mode] += p.opCycles[op];
+        }
+        return t;
+    }
+}
+
+void CPUProfiler::reset()
+{
+    std::fill(std::begin(opCount), std::end(opCount), 0);
+    std::fill(std::begin(opCycles), std::end(opCycles), 0);
+    std::fill(pcHits.begin(), pcHits.end(), 0);
+}
+
+void CPUProfiler::writeCSV(std::ostream &os) const
+{
+    os << "opcode,name,mode,count,cycles\n";
+    for (int op = 0; op < 256; op++)
+    {
+        if (!opCount[op])
+            continue;
+        const CPU6502::instruction &ins = CPU6502::lookup[op];
+        os << std::hex << std::uppercase << std::setw(2) << std::setfill('0') << op << std::dec
+           << ',' << ins.opcodename << ',' << CPU6502::addressingName(ins.addressing)
+           << ',' << opCount[op] << ',' << opCycles[op] << '\n';
+    }
+
+    ModeTotals modes = totalsByMode(*this);
+    os << "\nmode,count,cycles\n";
+    for (int m = 0; m < MODES; m++)
+    {
+        if (modes.count[m])
+            os << modeName(m) << ',' << modes.count[m] << ',' << modes.cycles[m] << '\n';
+    }
+
+    os << "\npc,hits\n";
+    for (int pc = 0; pc < 0x10000; pc++)
+    {
+        if (pcHits[pc])
+            os << std::hex << std::uppercase << std::setw(4) << std::setfill('0') << pc << std::dec
+               << ',' << pcHits[pc] << '\n';
+    }
+}
+
+void CPUProfiler::writeJSON(std::ostream &os) const
+{
+    const char *sep = "";
+    os << "{\n  \"opcodes\": [";
+    for (int op = 0; op < 256; op++)
+    {
+        if (!opCount[op])
+            continue;
+        const CPU6502::instruction &ins = CPU6502::lookup[op];
+        os << sep << "\n    {\"opcode\": " << op << ", \"name\": \"" << ins.opcodename
+           << "\", \"mode\": \"" << CPU6502::addressingName(ins.addressing)
+           << "\", \"count\": " << opCount[op] << ", \"cycles\": " << opCycles[op] << "}";
+        sep = ",";
+    }
+
+    ModeTotals modes = totalsByMode(*this);
+    sep = "";
+    os << "\n  ],\n  \"modes\": [";
+    for (int m = 0; m < MODES; m++)
+    {
+        if (!modes.count[m])
+            continue;
+        os << sep << "\n    {\"mode\": \"" << modeName(m) << "\", \"count\": " << modes.count[m]
+           << ", \"cycles\": " << modes.cycles[m] << "}";
+        sep = ",";
+    }
+
+    // Sparse: only addresses that were executed
+    sep = "";
+    os << "\n  ],\n  \"pcHits\": {";
+    for (int pc = 0; pc < 0x10000; pc++)
+    {
+        if (!pcHits[pc])
+            continue;
+        os << sep << "\n    \"" << pc << "\": " << pcHits[pc];
+        sep = ",";
+    }
+    os << "\n  }\n}\n";
+}
+
+bool CPUProfiler::exportTo(const std::string &path) const
+{
+    std::ofstream out(path);
+    if (!out)
+        return false;
+    bool json = path.size() >= 5 && path.compare(path.size() - 5, 5, ".json") == 0;
+    if (json)
+        writeJSON(out);
+    else
+        writeCSV(out);
+    return bool(out);
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Guest-side execution profile: per-opcode counts and cycles, and hits per PC
+// over the whole 64 KB address space. Addressing-mode totals are derived from
+// the opcode table on export. CPU6502 only uses this when SIMPLENES_PROFILE
+// is defined; otherwise it holds a NullProfiler and the hooks compile away.
+class CPUProfiler
+{
+public:
+    static constexpr bool enabled = true;
+
+    CPUProfiler() : pcHits(0x10000, 0) {}
+
+    void record(uint16_t pc, uint8_t opcode, uint8_t cycles)
+    {
+        opCount[opcode]++;
+        opCycles[opcode] += cycles;
+        pcHits[pc]++;
+    }
+
+    void reset();
+
+    // CSV has one section per table; JSON is a single object
+    void writeCSV(std::ostream &os) const;
+    void writeJSON(std::ostream &os) const;
+    // Picks the format from the extension (.json, anything else is CSV)
+    bool exportTo(const std::string &path) const;
+
+    uint64_t opCount[256] = {};
+    uint64_t opCycles[256] = {};
+    std::vector<uint64_t> pcHits;
+};
+
+class NullProfiler
+{
+public:
+    static constexpr bool enabled = false;
+
+    void record(uint16_t, uint8_t, uint8_t) {}
+    void reset() {}
+    void writeCSV(std::ostream &) const {}
+    void writeJSON(std::ostream &) const {}
+    bool exportTo(const std::string &) const { return false; }
+};
@@ -28,10 +28,10 @@ int main()
 uint32_t mapped;
 
 cart->mapper->cpuMapRead(0xFFFC, mapped);
-lo = cart->vPRGMemory[mapped];
+lo = cart->prg[mapped];
 
 cart->mapper->cpuMapRead(0xFFFD, mapped);
-hi = cart->vPRGMemory[mapped];
+hi = cart->prg[mapped];
 
 uint16_t resetVector = lo | (hi << 8);
 std::cout << "Reset vector points to: $" << std::hex << resetVector << "\n";
@@ -44,22 +44,18 @@ std::cout << "Reset vector points to: $" << std::hex << resetVector << "\n";
     std::cout << "ROM loaded via cartridge. Starting execution at \n" << std::hex << std::uppercase << std::setw(4) << std::setfill('0') 
           << cpu.PC << std::endl;
     cpu.PC = 0xC000;
-    std::cout << "PC    OP CODE      A  X  Y  P  SP  CYC" << std::endl;
-    std::cout << "-----------------------------------------" << std::endl;
-    std::string debug = cpu.debugStr();
-    if (!debug.empty()) {
-        std::cout << debug;
+    // Trace to a binary file; render it with tools/nestrace
+    TraceBuffer trace;
+    if (!trace.streamTo("cputest_trace.bin")) {
+        std::cerr << "Failed to open cputest_trace.bin" << std::endl;
+        return 1;
     }
-    ofstream fout("nestest_log.txt");
-    while (true) {
+    cpu.trace = &trace;
+    while (cpu.totalcycles <= 30000) {
         cpu.clock();
-        std::string debug = cpu.debugStr();
-        fout << debug;
-        std::cout << debug;
-        if (cpu.totalcycles > 30000) {
-            break;
-        }
     }
+    trace.closeStream();
+    std::cout << std::dec << trace.total() << " instructions traced to cputest_trace.bin" << std::endl;
 
     std::cout << "\nTest run complete." << std::endl;
     return 0;
@@ -1,130 +1,361 @@
+#include <algorithm>
+#include <atomic>
+#include <cstring>
 #include <iostream>
 #include <fstream>
+#include <memory>
 #include <vector>
 #include <iomanip>
 #include <sstream>
+#include <string>
+#include <thread>
 #include "json.hpp"
-#include "cpu6502.h"
-#include "bus.h"
+#include "CPU6502.h"
+#include "Bus.h"
+#include "SSTCorpus.h"
 
 using json = nlohmann::json;
 
-void printCPUState(const std::string& label, CPU6502& cpu)
+// SingleStepTests (v1/XX.json) runner. Opcode files are spread over a pool of
+// threads; each test checks registers, every final RAM cell and the number of
+// bus cycles. Failures are reported per opcode and per addressing mode.
+//
+//   CPUsst [testdir=v1] [-j threads]
+//   CPUsst --bin sst.bin [-j threads]
+//
+// --bin runs a corpus made by tools/sst2bin from a memory-mapped file, with
+// no JSON parsing or allocation per test.
+
+// The tests assume a flat 64 KB address space: this mapper claims every CPU
+// address for a 64 KB "PRG" so RAM mirrors and I/O registers don't apply.
+class FlatMapper : public Mapper
 {
-    std::cout << label << ":\n";
-    std::cout << "  PC=" << cpu.PC
-              << " A=" << (int)cpu.A
-              << " X=" << (int)cpu.X
-              << " Y=" << (int)cpu.Y
-              << " SP=" << (int)cpu.SP
-              << " P=" << (int)cpu.status.value
-              << "\n";
-}
+public:
+    FlatMapper() : Mapper(0, 0) {}
+    bool cpuMapRead(uint16_t addr, uint32_t &mapped_addr) override
+    {
+        mapped_addr = addr;
+        return true;
+    }
+    bool cpuMapWrite(uint16_t addr, uint32_t &mapped_addr) override
+    {
+        mapped_addr = addr;
+        return true;
+    }
+    bool ppuMapRead(uint16_t, uint32_t &) override { return false; }
+    bool ppuMapWrite(uint16_t, uint32_t &) override { return false; }
+};
+
+enum Failure
+{
+    FAIL_REGS = 1,
+    FAIL_RAM = 2,
+    FAIL_CYCLES = 4,
+};
+
+struct OpcodeResult
+{
+    bool found = false;
+    int total = 0;
+    int passed = 0;
+    int regs = 0, ram = 0, cycles = 0; // failures by kind
+    std::string firstFailure;
+};
+
+struct Machine
+{
+    std::shared_ptr<RomImage> image = std::make_shared<RomImage>();
+    std::shared_ptr<Cartridge> cart;
+    std::unique_ptr<Bus> bus = std::make_unique<Bus>();
+    uint8_t *mem = nullptr; // the flat 64 KB, private to this machine
+
+    Machine()
+    {
+        image->valid = true;
+        image->prg.assign(0x10000, 0);
+        cart = std::make_shared<Cartridge>(image);
+        cart->mapper = std::make_unique<FlatMapper>();
+        cart->writablePRG = mem = image->prg.data();
+        bus->insertCartridge(cart);
+        bus->cpu.connectBus(bus.get());
+        bus->cpu.detectIdleLoops = false;
+    }
+};
 
-void printJSONState(const std::string& label, const json& state)
+static std::string describe(const json &test, const json &final, CPU6502 &cpu, int failed, int cycles)
 {
-    std::cout << label << " (from JSON):\n";
-    std::cout << "  PC=" << state["pc"]
-              << " A=" << state["a"]
-              << " X=" << state["x"]
-              << " Y=" << state["y"]
-              << " SP=" << state["s"]
-              << " P=" << state["p"]
-              << "\n";
+    std::ostringstream os;
+    os << test["name"].get<std::string>() << ":";
+    if (failed & FAIL_REGS)
+    {
+        os << " expected PC=" << final["pc"] << " A=" << final["a"] << " X=" << final["x"]
+           << " Y=" << final["y"] << " SP=" << final["s"] << " P=" << final["p"]
+           << ", got PC=" << cpu.PC << " A=" << (int)cpu.A << " X=" << (int)cpu.X
+           << " Y=" << (int)cpu.Y << " SP=" << (int)cpu.SP << " P=" << (int)cpu.status.to_byte() << ";";
+    }
+    if (failed & FAIL_RAM)
+        os << " RAM differs;";
+    if (failed & FAIL_CYCLES)
+        os << " expected " << test["cycles"].size() << " cycles, got " << cycles << ";";
+    return os.str();
 }
 
-bool runTest(const json &test)
+static int runTest(const json &test, Machine &m, std::string &detail)
 {
-    CPU6502 cpu;
-    Bus bus;
-
-    // --- Load initial registers ---
-    cpu.PC = test["initial"]["pc"];
-    cpu.status.value = test["initial"]["p"];
-    cpu.A = test["initial"]["a"];
-    cpu.X = test["initial"]["x"];
-    cpu.Y = test["initial"]["y"];
-    cpu.SP = test["initial"]["s"];
-    cpu.status.from_byte(cpu.status.value);
+    CPU6502 &cpu = m.bus->cpu;
+    uint8_t *mem = m.mem;
+    const json &initial = test["initial"];
+    const json &final = test["final"];
+
+    // --- Load initial registers and memory ---
+    cpu.PC = initial["pc"];
+    cpu.A = initial["a"];
+    cpu.X = initial["x"];
+    cpu.Y = initial["y"];
+    cpu.SP = initial["s"];
+    cpu.status.from_byte(initial["p"].get<uint8_t>());
     cpu.cycles = 0;
+    for (auto &cell : initial["ram"])
+        mem[cell[0].get<uint16_t>()] = cell[1].get<uint8_t>();
+    cpu.flushDecodeCache();
 
-    for (auto &cell : test["initial"]["ram"])
+    int cycles = cpu.step();
+
+    // --- Check final state ---
+    int failed = 0;
+    if (cpu.PC != final["pc"] || cpu.status.to_byte() != final["p"] || cpu.A != final["a"] ||
+        cpu.X != final["x"] || cpu.Y != final["y"] || cpu.SP != final["s"])
+        failed |= FAIL_REGS;
+    for (auto &cell : final["ram"])
     {
-        uint16_t addr = cell[0].get<uint16_t>();
-        uint8_t val = cell[1].get<uint8_t>();
-        bus.CPUmem[addr] = val;
+        if (mem[cell[0].get<uint16_t>()] != cell[1].get<uint8_t>())
+            failed |= FAIL_RAM;
     }
-    cpu.connectBus(&bus);
-    cpu.clock();
-    do
+    if (cycles != int(test["cycles"].size()))
+        failed |= FAIL_CYCLES;
+
+    if (failed)
+        detail = describe(test, final, cpu, failed, cycles);
+
+    // Leave memory clean for the next test
+    for (auto &cell : initial["ram"])
+        mem[cell[0].get<uint16_t>()] = 0;
+    for (auto &cell : final["ram"])
+        mem[cell[0].get<uint16_t>()] = 0;
+    return failed;
+}
+
+static int runCase(const sst::Case &c, const sst::Cell *cells, Machine &m, int &cycles)
+{
+    CPU6502 &cpu = m.bus->cpu;
+    uint8_t *mem = m.mem;
+    const sst::Cell *initialRam = cells + c.firstCell;
+    const sst::Cell *finalRam = initialRam + c.initialCells;
+
+    cpu.PC = c.initial.pc;
+    cpu.A = c.initial.a;
+    cpu.X = c.initial.x;
+    cpu.Y = c.initial.y;
+    cpu.SP = c.initial.s;
+    cpu.status.from_byte(c.initial.p);
+    cpu.cycles = 0;
+    for (int i = 0; i < c.initialCells; i++)
+        mem[initialRam[i].addr] = initialRam[i].value;
+    cpu.flushDecodeCache();
+
+    cycles = cpu.step();
+
+    int failed = 0;
+    if (cpu.PC != c.final.pc || cpu.status.to_byte() != c.final.p || cpu.A != c.final.a ||
+        cpu.X != c.final.x || cpu.Y != c.final.y || cpu.SP != c.final.s)
+        failed |= FAIL_REGS;
+    for (int i = 0; i < c.finalCells; i++)
     {
-        cpu.clock();
-    } while (cpu.cycles > 0);
+        if (mem[finalRam[i].addr] != finalRam[i].value)
+            failed |= FAIL_RAM;
+    }
+    if (cycles != c.cycles)
+        failed |= FAIL_CYCLES;
+    return failed;
+}
 
-    // --- Check final state ---
-    bool ok = true;
-    auto final = test["final"];
-    if (cpu.PC != final["pc"])
-        ok = false;
-    if (cpu.status.value != final["p"])
-        ok = false;
-    if (cpu.A != final["a"])
-        ok = false;
-    if (cpu.X != final["x"])
-        ok = false;
-    if (cpu.Y != final["y"])
-        ok = false;
-    if (cpu.SP != final["s"])
-        ok = false;
-
-    if (!ok){
-        std::cout << "Mismatch detected!\n";
-        printJSONState("Expected Final", final);
-        printCPUState("CPU After Exec", cpu);
+static std::string describeCase(const sst::Case &c, uint32_t index, CPU6502 &cpu, int failed, int cycles)
+{
+    // The corpus drops test names; the index within the opcode file identifies it
+    std::ostringstream os;
+    os << "test " << index << " (PC=" << c.initial.pc << "):";
+    if (failed & FAIL_REGS)
+    {
+        os << " expected PC=" << c.final.pc << " A=" << (int)c.final.a << " X=" << (int)c.final.x
+           << " Y=" << (int)c.final.y << " SP=" << (int)c.final.s << " P=" << (int)c.final.p
+           << ", got PC=" << cpu.PC << " A=" << (int)cpu.A << " X=" << (int)cpu.X
+           << " Y=" << (int)cpu.Y << " SP=" << (int)cpu.SP << " P=" << (int)cpu.status.to_byte() << ";";
     }
-    return ok;
+    if (failed & FAIL_RAM)
+        os << " RAM differs;";
+    if (failed & FAIL_CYCLES)
+        os << " expected " << (int)c.cycles << " cycles, got " << cycles << ";";
+    return os.str();
 }
 
-int main()
+static void runCorpus(const sst::Corpus &corpus, int opcode, Machine &m, OpcodeResult &result)
 {
-    int passed = 0;
-    int total = 0;
+    uint32_t first = corpus.header->opcodeStart[opcode];
+    uint32_t last = corpus.header->opcodeStart[opcode + 1];
+    if (first == last)
+        return;
+    result.found = true;
 
-    // Loop through 256 JSON files (00.json .. FF.json)
-    for (int opcode = 0; opcode <= 0xFF; opcode++)
+    uint8_t *mem = m.mem;
+    for (uint32_t i = first; i < last; i++)
     {
-        std::stringstream filename;
-        filename << "v1/"
-                 << std::uppercase << std::hex << std::setw(2) << std::setfill('0')
-                 << opcode << ".json";
+        const sst::Case &c = corpus.cases[i];
+        int cycles = 0;
+        int failed = runCase(c, corpus.cells, m, cycles);
+        result.total++;
+        if (!failed)
+            result.passed++;
+        else
+        {
+            result.regs += (failed & FAIL_REGS) != 0;
+            result.ram += (failed & FAIL_RAM) != 0;
+            result.cycles += (failed & FAIL_CYCLES) != 0;
+            if (result.firstFailure.empty())
+                result.firstFailure = describeCase(c, i - first, m.bus->cpu, failed, cycles);
+        }
 
-        std::ifstream f(filename.str());
-        if (!f.is_open())
+        // Leave memory clean for the next test
+        const sst::Cell *ram = corpus.cells + c.firstCell;
+        for (int k = 0; k < c.initialCells + c.finalCells; k++)
+            mem[ram[k].addr] = 0;
+    }
+}
+
+static void runFile(const std::string &path, Machine &m, OpcodeResult &result)
+{
+    std::ifstream f(path);
+    if (!f.is_open())
+        return;
+
+    json tests;
+    f >> tests;
+    result.found = true;
+
+    for (auto &t : tests)
+    {
+        std::string detail;
+        int failed = runTest(t, m, detail);
+        result.total++;
+        if (!failed)
         {
-            std::cerr << "Could not open " << filename.str() << "\n";
-            continue; // skip missing files
+            result.passed++;
+            continue;
         }
+        result.regs += (failed & FAIL_REGS) != 0;
+        result.ram += (failed & FAIL_RAM) != 0;
+        result.cycles += (failed & FAIL_CYCLES) != 0;
+        if (result.firstFailure.empty())
+            result.firstFailure = detail;
+    }
+}
 
-        json tests;
-        f >> tests;
+int main(int argc, char **argv)
+{
+    std::string dir = "v1";
+    std::string corpusPath;
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+            threads = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--bin") == 0 && i + 1 < argc)
+            corpusPath = argv[++i];
+        else
+            dir = argv[i];
+    }
 
-        for (auto &t : tests)
+    sst::MappedFile corpusFile;
+    sst::Corpus corpus;
+    if (!corpusPath.empty())
+    {
+        std::string error = "cannot be opened";
+        if (!corpusFile.open(corpusPath) || !corpus.attach(corpusFile, error))
         {
-            total++;
-            if (runTest(t))
-                passed++;
-            else
-                std::cerr << "Failed test in " << filename.str() << " : " << t["name"] << "\n";
+            std::cout << corpusPath << ": " << error << "\n";
+            return 1;
         }
+        dir = corpusPath;
     }
 
-    if (total > 0)
+    std::vector<OpcodeResult> results(256);
+    std::atomic<int> nextOpcode{0};
+    auto worker = [&]()
+    {
+        Machine m;
+        for (int opcode; (opcode = nextOpcode++) <= 0xFF;)
+        {
+            if (corpus.header)
+            {
+                runCorpus(corpus, opcode, m, results[opcode]);
+                continue;
+            }
+            std::stringstream filename;
+            filename << dir << "/"
+                     << std::uppercase << std::hex << std::setw(2) << std::setfill('0')
+                     << opcode << ".json";
+            runFile(filename.str(), m, results[opcode]);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (unsigned i = 0; i < threads; i++)
+        pool.emplace_back(worker);
+    for (auto &t : pool)
+        t.join();
+
+    // --- Report ---
+    long passed = 0, total = 0;
+    int missing = 0;
+    long modeTotal[CPU6502::ADDRESSING_MODES] = {}, modeFailed[CPU6502::ADDRESSING_MODES] = {};
+    for (int opcode = 0; opcode <= 0xFF; opcode++)
     {
-        std::cout << "Passed " << passed << " / " << total
-                  << " tests (" << (passed * 10000 / total) << "/10000)\n";
+        const OpcodeResult &r = results[opcode];
+        if (!r.found)
+        {
+            missing++;
+            continue;
+        }
+        const CPU6502::instruction &ins = CPU6502::lookup[opcode];
+        int mode = static_cast<int>(ins.addressing);
+        total += r.total;
+        passed += r.passed;
+        modeTotal[mode] += r.total;
+        modeFailed[mode] += r.total - r.passed;
+        if (r.passed == r.total)
+            continue;
+
+        std::cout << std::uppercase << std::hex << std::setw(2) << std::setfill('0') << opcode << std::dec
+                  << " " << ins.opcodename << " " << CPU6502::addressingName(ins.addressing) << ": "
+                  << r.total - r.passed << "/" << r.total << " failed (regs " << r.regs << ", ram "
+                  << r.ram << ", cycles " << r.cycles << ")\n    first: " << r.firstFailure << "\n";
     }
-    else
+
+    if (total == 0)
     {
         std::cout << "No tests found!\n";
+        return 1;
+    }
+
+    std::cout << "\nBy addressing mode:\n";
+    for (int mode = 0; mode < CPU6502::ADDRESSING_MODES; mode++)
+    {
+        if (modeTotal[mode])
+            std::cout << "  " << CPU6502::addressingName(static_cast<CPU6502::Addressing>(mode)) << ": "
+                      << modeFailed[mode] << " failed of " << modeTotal[mode] << "\n";
     }
+    if (missing)
+        std::cout << missing << " opcodes missing from " << dir << "\n";
+    std::cout << "Passed " << passed << " / " << total
+              << " tests (" << (passed * 10000 / total) << "/10000)\n";
+    return passed == total ? 0 : 1;
 }
@@ -1,7 +1,10 @@
 #include "Emulator.h"
 #include <iostream>
 #include <chrono>
+#include <fstream>
+#include <iterator>
 #include <thread>
+#include <cstdlib>
 #include <SDL2/SDL.h> // for event polling constants if needed
 
 Emulator::Emulator()
@@ -12,6 +15,12 @@ Emulator::Emulator()
 Emulator::~Emulator()
 {
     stop();
+    if constexpr (CPU6502::Profiler::enabled)
+    {
+        const char *path = std::getenv("SIMPLENES_PROFILE_OUT");
+        if (!bus.cpu.profiler.exportTo(path ? path : "simplenes_profile.csv"))
+            std::cerr << "Emulator: failed to write CPU profile" << std::endl;
+    }
 }
 
 bool Emulator::loadROM(const std::string &path)
@@ -22,6 +31,7 @@ bool Emulator::loadROM(const std::string &path)
         std::cerr << "Emulator: failed to load ROM: " << path << std::endl;
         return false;
     }
+    romPath = path;
 
     // Insert cartridge into bus (assumes Bus::insertCartridge exists)
     bus.insertCartridge(cart);
@@ -34,6 +44,7 @@ bool Emulator::loadROM(const std::string &path)
     bus.ppu.scanline_cycle = -1; // pre-render line
     bus.ppu.dot = 0;
     bus.ppu.frame_complete = false;
+    bus.nextEvent = 0; // re-predict PPU events from the new position
     // Connect PPU to bus and cartridge (some of these calls may already be performed
     // inside Bus::insertCartridge; safe to repeat if your methods are idempotent)
     bus.ppu.connectBus(&bus);
@@ -54,6 +65,7 @@ void Emulator::reset()
     bus.ppu.dot = 0;
     bus.ppu.frame_complete = false;
     bus.ppu.v = bus.ppu.t = bus.ppu.x = bus.ppu.w = 0;
+    bus.nextEvent = 0;
     // Reset cartridge / mapper state if you have such APIs (optional)
     // if (cart) cart->reset();
 }
@@ -69,16 +81,21 @@ void Emulator::run()
     {
         // Run cycles until a frame is produced
         handleEvents();
-        do
+        PPU2C02 *shown = &bus.ppu;
+        if (!rewinding)
         {
-            bus.cpu.clock();
-            bus.ppu.tick();
-            bus.ppu.tick();
-            bus.ppu.tick();
-        } while (!bus.ppu.frame_complete);
+            shown = &runAhead.runFrame(bus);
+            rewind.capture(bus);
+        }
+        else if (rewind.stepBack(bus))
+        {
+            // The framebuffer isn't saved; re-run the frame after the restored
+            // point to redraw it. Stands still once history runs out.
+            bus.runFrame();
+            bus.ppu.frame_complete = false;
+        }
         // Present frame
-        presentFrame();
-        bus.ppu.frame_complete = false;
+        presentFrame(*shown);
 
         // Now handle SDL input (once per frame)
 
@@ -104,6 +121,17 @@ void Emulator::stop()
     running = false;
 }
 
+bool Emulator::setRunAhead(unsigned frames, bool secondInstance)
+{
+    runAhead.frames = frames;
+    if (!secondInstance || !frames)
+    {
+        runAhead.disableSecondInstance();
+        return true;
+    }
+    return cart && runAhead.enableSecondInstance(cart->rom);
+}
+
 void Emulator::stepCycle()
 {
     // Execute one CPU cycle. Your CPU implementation may produce either
@@ -127,6 +155,13 @@ void Emulator::handleEvents()
     {
         if (event.type == SDL_QUIT)
             stop();
+        else if (event.type == SDL_KEYDOWN && !event.key.repeat)
+        {
+            if (event.key.keysym.sym == SDLK_F5)
+                saveStateFile();
+            else if (event.key.keysym.sym == SDLK_F9)
+                loadStateFile();
+        }
     }
 
     // ---- CONTROLLER STATE POLLING ----
@@ -140,13 +175,33 @@ void Emulator::handleEvents()
     bus.setButton(0, Bus::NES_DOWN,   keys[SDL_SCANCODE_DOWN]);
     bus.setButton(0, Bus::NES_LEFT,   keys[SDL_SCANCODE_LEFT]);
     bus.setButton(0, Bus::NES_RIGHT,  keys[SDL_SCANCODE_RIGHT]);
+    rewinding = keys[SDL_SCANCODE_BACKSPACE];
+}
+
+void Emulator::saveStateFile()
+{
+    bus.saveState(stateBuffer);
+    std::ofstream out(romPath + ".state", std::ios::binary);
+    out.write(reinterpret_cast<const char *>(stateBuffer.data()), stateBuffer.size());
+    if (!out)
+        std::cerr << "Emulator: failed to write " << romPath << ".state" << std::endl;
+}
+
+void Emulator::loadStateFile()
+{
+    std::ifstream in(romPath + ".state", std::ios::binary);
+    std::vector<uint8_t> state((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (!bus.loadState(state))
+        std::cerr << "Emulator: no usable save state at " << romPath << ".state" << std::endl;
+    else
+        rewind.clear();
 }
 
-void Emulator::presentFrame()
+void Emulator::presentFrame(PPU2C02 &ppu)
 {
     // 1. Clear and draw NES framebuffer
-    renderer.beginFrame();       // SDL_RenderClear
-    renderer.drawFrame(bus.ppu); // SDL_RenderCopy(texture)
+    renderer.beginFrame();   // SDL_RenderClear
+    renderer.drawFrame(ppu); // SDL_RenderCopy(texture)
 
     // 2. Prepare OAM debug buffer
     // static uint32_t oamDebugTex[64 * 64];
@@ -5,8 +5,10 @@
 #include <atomic>
 
 #include "Bus.h"        // your Bus (contains CPU & PPU instances)
-#include "Cartridge.h"  // your Cartridge
+#include "CARTRIDGE.h"  // your Cartridge
 #include "Renderer.h"   // SDL3 renderer from earlier
+#include "Rewind.h"
+#include "RunAhead.h"
 
 class Emulator {
 public:
@@ -25,6 +27,10 @@ public:
     // Stop the emulator loop (safe to call from another thread).
     void stop();
 
+    // Show the picture from frames ahead (see RunAhead.h). Call after loadROM.
+    // Returns false if the second instance couldn't be created.
+    bool setRunAhead(unsigned frames, bool secondInstance);
+
 private:
     // Single-step: one CPU cycle + 3 PPU ticks (typical NES timing)
     void stepCycle();
@@ -33,11 +39,20 @@ private:
     void handleEvents();
 
     // Helper to present framebuffer when PPU signals frame complete
-    void presentFrame();
+    void presentFrame(PPU2C02 &ppu);
+
+    // Quick save (F5) / quick load (F9) to <rom>.state
+    void saveStateFile();
+    void loadStateFile();
 
     // Members
     Bus bus; // bus contains cpu and ppu objects (matching your code)
     std::shared_ptr<Cartridge> cart;
+    std::string romPath;
+    std::vector<uint8_t> stateBuffer;
+    RewindBuffer rewind;
+    bool rewinding = false; // Backspace held
+    RunAhead runAhead;
     Renderer renderer;
 
     std::atomic<bool> running{false};
@@ -0,0 +1,171 @@
+#include "FrameConvert.h"
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRAMECONVERT_SSE2
+#include <emmintrin.h>
+#endif
+// AVX2 is compiled per function and chosen at run time, so the rest of the
+// build doesn't need -mavx2
+#if defined(FRAMECONVERT_SSE2) && defined(__GNUC__)
+#define FRAMECONVERT_AVX2
+#include <immintrin.h>
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace
+{
+    // The PPU's ARGB table, rebuilt when systempalette has changed since it
+    // was last built. An emphasis bit darkens the two channels it doesn't
+    // name, by about the factor the 2C02's attenuator applies to the video
+    // signal.
+    const PPU2C02::OutputColors &paletteTable(PPU2C02 &ppu)
+    {
+        PPU2C02::OutputColors &t = ppu.outputColors;
+        if (t.valid && memcmp(t.source.data(), ppu.systempalette.data(), sizeof(t.source)) == 0)
+            return t;
+
+        t.source = ppu.systempalette;
+        for (int e = 0; e < 8; e++)
+        {
+            for (int i = 0; i < 64; i++)
+            {
+                auto c = ppu.systempalette[i];
+                auto dim = [&](uint8_t v, int own) { return uint32_t((e & ~own) ? v * 0.816328 + 0.5 : v); };
+                t.argb[e][i] = 0xFF000000 | (dim(c.r, 1) << 16) | (dim(c.g, 2) << 8) | dim(c.b, 4);
+            }
+        }
+        t.valid = true;
+        return t;
+    }
+
+    // The kernels step pointers with fixed offsets and make no calls: the
+    // project builds without optimization, where every index expression and
+    // call goes through memory.
+    void lineScalar(const uint8_t *src, uint32_t *dst, const uint32_t *colors)
+    {
+        for (const uint8_t *end = src + 256; src < end; src += 8, dst += 8)
+        {
+            dst[0] = colors[src[0]];
+            dst[1] = colors[src[1]];
+            dst[2] = colors[src[2]];
+            dst[3] = colors[src[3]];
+            dst[4] = colors[src[4]];
+            dst[5] = colors[src[5]];
+            dst[6] = colors[src[6]];
+            dst[7] = colors[src[7]];
+        }
+    }
+
+#ifdef FRAMECONVERT_SSE2
+    // SSE2 has no byte shuffle or gather to look colors up with, so this
+    // reads the table once per pixel like the scalar loop and only stores in
+    // 16-byte blocks.
+    void lineSSE2(const uint8_t *src, uint32_t *dst, const uint32_t *colors)
+    {
+        for (const uint8_t *end = src + 256; src < end; src += 8, dst += 8)
+        {
+            __m128i lo = _mm_setr_epi32(colors[src[0]], colors[src[1]], colors[src[2]], colors[src[3]]);
+            __m128i hi = _mm_setr_epi32(colors[src[4]], colors[src[5]], colors[src[6]], colors[src[7]]);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst), lo);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 4), hi);
+        }
+    }
+#endif
+
+#ifdef FRAMECONVERT_AVX2
+    // 32 indices per step, widened eight at a time to dwords and looked up
+    // with one gather each
+    TARGET_AVX2 void lineAVX2(const uint8_t *src, uint32_t *dst, const uint32_t *colors)
+    {
+        const int *table = reinterpret_cast<const int *>(colors);
+        for (const uint8_t *end = src + 256; src < end; src += 32, dst += 32)
+        {
+            __m256i idx = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src));
+            __m128i lo = _mm256_castsi256_si128(idx);
+            __m128i hi = _mm256_extracti128_si256(idx, 1);
+            __m256i *out = reinterpret_cast<__m256i *>(dst);
+            _mm256_storeu_si256(out + 0, _mm256_i32gather_epi32(table, _mm256_cvtepu8_epi32(lo), 4));
+            _mm256_storeu_si256(out + 1, _mm256_i32gather_epi32(table, _mm256_cvtepu8_epi32(_mm_srli_si128(lo, 8)), 4));
+            _mm256_storeu_si256(out + 2, _mm256_i32gather_epi32(table, _mm256_cvtepu8_epi32(hi), 4));
+            _mm256_storeu_si256(out + 3, _mm256_i32gather_epi32(table, _mm256_cvtepu8_epi32(_mm_srli_si128(hi, 8)), 4));
+        }
+    }
+#endif
+}
+
+bool convertKernelSupported(ConvertKernel kernel)
+{
+    switch (kernel)
+    {
+    case ConvertKernel::Scalar:
+        return true;
+#ifdef FRAMECONVERT_SSE2
+    case ConvertKernel::SSE2:
+        return true;
+#endif
+#ifdef FRAMECONVERT_AVX2
+    case ConvertKernel::AVX2:
+        return __builtin_cpu_supports("avx2");
+#endif
+    default:
+        return false;
+    }
+}
+
+// Without a gather, SSE2 does the same table loads as the scalar loop and
+// measures a little slower than it, so it is never the default
+ConvertKernel bestConvertKernel()
+{
+    static const ConvertKernel best =
+        convertKernelSupported(ConvertKernel::AVX2) ? ConvertKernel::AVX2 : ConvertKernel::Scalar;
+    return best;
+}
+
+const char *convertKernelName(ConvertKernel kernel)
+{
+    switch (kernel)
+    {
+    case ConvertKernel::SSE2:
+        return "sse2";
+    case ConvertKernel::AVX2:
+        return "avx2";
+    default:
+        return "scalar";
+    }
+}
+
+void convertFrameARGB(PPU2C02 &ppu, uint32_t *dst, int pitch)
+{
+    convertFrameARGB(ppu, dst, pitch, bestConvertKernel());
+}
+
+void convertFrameARGB(PPU2C02 &ppu, uint32_t *dst, int pitch, ConvertKernel kernel)
+{
+    auto line = lineScalar;
+#ifdef FRAMECONVERT_SSE2
+    if (kernel == ConvertKernel::SSE2)
+        line = lineSSE2;
+#endif
+#ifdef FRAMECONVERT_AVX2
+    if (kernel == ConvertKernel::AVX2 && convertKernelSupported(kernel))
+        line = lineAVX2;
+#endif
+
+    const PPU2C02::OutputColors &table = paletteTable(ppu);
+    for (int y = 0; y < 240; y++)
+    {
+        uint32_t *row = reinterpret_cast<uint32_t *>(reinterpret_cast<uint8_t *>(dst) + y * pitch);
+        line(ppu.framebuffer[y].data(), row, table.argb[ppu.lineEmphasis[y] >> 5]);
+    }
+
+    // Emphasis changed mid-line: redo the rest of the line with the new bits
+    for (const PPU2C02::EmphasisChange &c : ppu.emphasisChanges)
+    {
+        const uint32_t *colors = table.argb[c.bits >> 5];
+        const uint8_t *src = ppu.framebuffer[c.y].data();
+        uint32_t *row = reinterpret_cast<uint32_t *>(reinterpret_cast<uint8_t *>(dst) + c.y * pitch);
+        for (int x = c.x; x < 256; x++)
+            row[x] = colors[src[x]];
+    }
+}
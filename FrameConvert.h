@@ -0,0 +1,25 @@
+#pragma once
+#include <cstdint>
+#include "PPU2C02.h"
+
+// Converts the PPU framebuffer (palette colors, see PPU2C02::framebuffer) to
+// 32-bit ARGB (0xAARRGGBB), the layout of an SDL ARGB8888 streaming texture,
+// applying color emphasis, including changes within a line. pitch is the
+// distance between rows in bytes, so dst can be locked texture memory. Kept out of Renderer so the
+// benchmark can time it without SDL.
+void convertFrameARGB(PPU2C02 &ppu, uint32_t *dst, int pitch);
+
+// The same conversion with a given kernel. All of them give identical
+// pixels; the one-argument form above uses bestConvertKernel(), picked once
+// at run time from what the CPU supports. Passing a kernel that
+// convertKernelSupported() rejects falls back to Scalar.
+enum class ConvertKernel
+{
+    Scalar,
+    SSE2, // table lookups, 8 pixels per step with 128-bit stores
+    AVX2  // 32 pixels per step, eight per gather
+};
+bool convertKernelSupported(ConvertKernel kernel);
+ConvertKernel bestConvertKernel();
+const char *convertKernelName(ConvertKernel kernel);
+void convertFrameARGB(PPU2C02 &ppu, uint32_t *dst, int pitch, ConvertKernel kernel);
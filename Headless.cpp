@@ -0,0 +1,83 @@
+// SimpleNES without a display: runs a ROM for a number of frames or CPU
+// cycles and reports throughput and a hash of the final frame and RAM.
+//
+//   SimpleNES-headless rom.nes [--frames N] [--cycles N] [--input movie.fm2] [--jit] [--dot-renderer]
+//
+// With neither limit it runs 600 frames. --input plays back an FCEUX-style
+// movie (see Playback.h). --dot-renderer turns off the whole-line PPU renderer
+// (PPU2C02::tickLine), which must give the same hashes.
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Bus.h"
+#include "Playback.h"
+
+int main(int argc, char **argv)
+{
+    uint64_t maxFrames = 0;
+    uint64_t maxCycles = 0;
+    bool jit = false;
+    bool dotRenderer = false;
+    std::string moviePath;
+    std::vector<std::string> files;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            maxFrames = strtoull(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--cycles") == 0 && i + 1 < argc)
+            maxCycles = strtoull(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc)
+            moviePath = argv[++i];
+        else if (strcmp(argv[i], "--jit") == 0)
+            jit = true;
+        else if (strcmp(argv[i], "--dot-renderer") == 0)
+            dotRenderer = true;
+        else
+            files.push_back(argv[i]);
+    }
+    if (files.size() != 1)
+    {
+        std::cerr << "usage: SimpleNES-headless rom.nes [--frames N] [--cycles N] [--input movie.fm2] [--jit] [--dot-renderer]\n";
+        return 2;
+    }
+    if (!maxFrames && !maxCycles)
+        maxFrames = 600;
+
+    std::vector<InputFrame> movie;
+    if (!moviePath.empty() && !loadMovie(moviePath, movie))
+    {
+        std::cerr << "SimpleNES-headless: cannot read " << moviePath << "\n";
+        return 1;
+    }
+
+    auto cart = std::make_shared<Cartridge>(files[0]);
+    if (!cart->isImageValid())
+    {
+        std::cerr << "SimpleNES-headless: failed to load ROM: " << files[0] << "\n";
+        return 1;
+    }
+    auto bus = std::make_unique<Bus>();
+    bus->insertCartridge(cart);
+    bus->cpu.connectBus(bus.get());
+    bus->cpu.reset();
+    bus->ppu.connectCartridge(cart);
+    bus->cpu.useRecompiler = jit;
+    bus->ppu.lineRenderer = !dotRenderer;
+
+    auto t0 = std::chrono::steady_clock::now();
+    PlaybackResult run = play(*bus, movie, maxFrames, maxCycles);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    printf("frames %llu, cycles %llu, %.3f s\n", (unsigned long long)run.frames, (unsigned long long)run.cycles, seconds);
+    printf("%.1f frames/s, %.0f cycles/s\n", seconds > 0 ? run.frames / seconds : 0.0,
+           seconds > 0 ? run.cycles / seconds : 0.0);
+    printf("frame hash %016llx, RAM hash %016llx\n", (unsigned long long)frameHash(bus->ppu), (unsigned long long)ramHash(*bus));
+    return 0;
+}
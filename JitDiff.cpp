@@ -0,0 +1,312 @@
+// Differential test for the native block translator. Builds NROM images in
+// memory from a seeded generator (loops, subroutines, indexed and indirect
+// addressing, undocumented opcodes, decimal mode and an NMI handler), runs each one for a number of frames on the interpreter and on
+// the translator, and compares registers, internal RAM, cycle counts and the
+// frame.
+//
+//   JitDiff [programs=24] [frames=60] [first seed=1]
+//
+// Exit codes: 0 pass, 1 mismatch or nothing was translated, 77 (skipped)
+// when the host has no native backend.
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "Bus.h"
+#include "CPU6502.h"
+#include "Playback.h"
+
+namespace
+{
+    using Addressing = CPU6502::Addressing;
+
+    // Loop counters and the JMP (ind) pointer; generated stores stay clear of
+    // them and of the stack page
+    constexpr uint16_t COUNTERS = 0x07F0;
+    constexpr uint16_t POINTER = 0x0310;
+
+    class ProgramGen
+    {
+    public:
+        explicit ProgramGen(uint32_t seed) : rng(seed)
+        {
+            for (int op = 0; op < 256; op++)
+            {
+                std::string name = CPU6502::lookup[op].opcodename;
+                bool control = name == "JMP" || name == "JSR" || name == "RTS" || name == "RTI" ||
+                               name == "BRK" || name == "KIL" || name == "CLI" ||
+                               CPU6502::lookup[op].addressing == Addressing::REL;
+                bool stack = name == "PHA" || name == "PLA" || name == "PHP" || name == "PLP" || name == "TXS";
+                if (CPU6502::lookup[op].addressing == Addressing::REL)
+                    branches.push_back(uint8_t(op));
+                else if (!control && !stack)
+                    plain.push_back(uint8_t(op));
+            }
+        }
+
+        std::shared_ptr<const RomImage> build()
+        {
+            code.clear();
+            // SEI CLD LDX #$FF TXS, NMI on, rendering on, CLI
+            emit({0x78, 0xD8, 0xA2, 0xFF, 0x9A, 0xA9, 0x80, 0x8D, 0x00, 0x20, 0xA9, 0x1E, 0x8D, 0x01, 0x20, 0x58});
+            uint16_t mainLoop = here();
+
+            std::vector<size_t> calls;
+            int segments = 8 + pick(12);
+            for (int s = 0; s < segments; s++)
+            {
+                uint32_t kind = pick(100);
+                if (kind < 40)
+                {
+                    straight(2 + pick(12));
+                }
+                else if (kind < 70)
+                {
+                    // Counted loop: LDA #k STA c ... DEC c BNE top
+                    uint16_t c = COUNTERS + pick(8);
+                    emit({0xA9, uint8_t(2 + pick(38)), 0x8D, uint8_t(c), uint8_t(c >> 8)});
+                    uint16_t top = here();
+                    straight(1 + pick(9));
+                    emit({0xCE, uint8_t(c), uint8_t(c >> 8)});
+                    int offset = top - (here() + 2);
+                    if (offset >= -128)
+                        emit({0xD0, uint8_t(offset)});
+                }
+                else if (kind < 85)
+                {
+                    calls.push_back(code.size());
+                    emit({0x20, 0x00, 0x00});
+                }
+                else
+                {
+                    // JMP (POINTER) to the next instruction
+                    uint16_t target = here() + 13;
+                    emit({0xA9, uint8_t(target), 0x8D, uint8_t(POINTER), uint8_t(POINTER >> 8),
+                          0xA9, uint8_t(target >> 8), 0x8D, uint8_t(POINTER + 1), uint8_t(POINTER >> 8),
+                          0x6C, uint8_t(POINTER), uint8_t(POINTER >> 8)});
+                }
+            }
+            emit({0x4C, uint8_t(mainLoop), uint8_t(mainLoop >> 8)});
+
+            uint16_t subs[4];
+            for (uint16_t &sub : subs)
+            {
+                sub = here();
+                straight(1 + pick(11));
+                if (pick(5) == 0)
+                    emit({0x08, 0x28}); // PHP PLP
+                emit({0x60});
+            }
+            for (size_t at : calls)
+            {
+                uint16_t sub = subs[pick(4)];
+                code[at + 1] = uint8_t(sub);
+                code[at + 2] = uint8_t(sub >> 8);
+            }
+
+            // NMI saves A/X around its body
+            uint16_t nmi = here();
+            emit({0x48, 0x8A, 0x48});
+            straight(1 + pick(7));
+            emit({0x68, 0xAA, 0x68, 0x40});
+            uint16_t irq = here();
+            emit({0x48});
+            straight(pick(5));
+            emit({0x68, 0x40});
+
+            auto image = std::make_shared<RomImage>();
+            image->valid = true;
+            image->mapperID = 0;
+            image->prgBanks = 2;
+            image->chrBanks = 0;
+            image->mirror = RomImage::MIRROR::VERTICAL;
+            image->prg.resize(0x8000);
+            for (size_t i = 0; i < image->prg.size(); i++)
+                image->prg[i] = i < code.size() ? code[i] : uint8_t(rng()); // the rest is data for ROM reads
+            const uint16_t vectors[3] = {nmi, 0x8000, irq};
+            for (int v = 0; v < 3; v++)
+            {
+                image->prg[0x7FFA + v * 2] = uint8_t(vectors[v]);
+                image->prg[0x7FFB + v * 2] = uint8_t(vectors[v] >> 8);
+            }
+            return image;
+        }
+
+    private:
+        std::mt19937 rng;
+        std::vector<uint8_t> plain;
+        std::vector<uint8_t> branches;
+        std::vector<uint8_t> code;
+
+        uint32_t pick(uint32_t n) { return rng() % n; }
+        uint16_t here() const { return uint16_t(0x8000 + code.size()); }
+        void emit(std::initializer_list<uint8_t> bytes) { code.insert(code.end(), bytes); }
+
+        static bool writes(uint8_t op)
+        {
+            static const char *const names[] = {"STA", "STX", "STY", "SAX", "AHX", "SHX", "SHY", "TAS", "ASL", "LSR",
+                                                 "ROL", "ROR", "INC", "DEC", "SLO", "RLA", "SRE", "RRA", "DCP", "ISC"};
+            for (const char *name : names)
+                if (strcmp(CPU6502::lookup[op].opcodename, name) == 0)
+                    return true;
+            return false;
+        }
+
+        uint16_t address()
+        {
+            uint32_t r = pick(100);
+            if (r < 55)
+                return uint16_t(pick(0x800));
+            if (r < 65)
+                return uint16_t(0x800 + pick(0x1800));
+            if (r < 90)
+                return uint16_t(0x8000 + pick(0x8000));
+            static const uint16_t io[] = {0x2002, 0x2000, 0x2005, 0x2007, 0x4015, 0x4016, 0x4017};
+            return io[pick(7)];
+        }
+
+        static bool reserved(uint16_t addr)
+        {
+            if (addr >= 0x2000)
+                return true;
+            addr &= 0x07FF;
+            return addr >= COUNTERS || (addr & 0x0700) == 0x0100 || (addr & 0xFFFE) == POINTER;
+        }
+
+        std::vector<uint8_t> randomOp()
+        {
+            uint8_t op = plain[pick(uint32_t(plain.size()))];
+            std::vector<uint8_t> bytes{op};
+            uint8_t length = CPU6502::instrLength(CPU6502::lookup[op].addressing);
+            if (length == 2)
+            {
+                bytes.push_back(uint8_t(pick(256)));
+            }
+            else if (length == 3)
+            {
+                uint16_t addr = address();
+                while (writes(op) && reserved(addr))
+                    addr = address();
+                bytes.push_back(uint8_t(addr));
+                bytes.push_back(uint8_t(addr >> 8));
+            }
+            if (pick(100) < 8)
+            {
+                bytes.insert(bytes.begin(), pick(2) ? 0x48 : 0x08);
+                bytes.push_back(pick(2) ? 0x68 : 0x28);
+            }
+            return bytes;
+        }
+
+        // Straight-line ops, some followed by a forward branch over the next few
+        void straight(uint32_t count)
+        {
+            std::vector<std::vector<uint8_t>> body;
+            for (uint32_t i = 0; i < count; i++)
+                body.push_back(randomOp());
+            for (size_t i = 0; i + 1 < body.size(); i++)
+            {
+                if (pick(100) >= 15)
+                    continue;
+                size_t end = i + 1 + pick(uint32_t(body.size() - i));
+                size_t skip = 0;
+                for (size_t j = i + 1; j < end; j++)
+                    skip += body[j].size();
+                if (skip < 128)
+                {
+                    body[i].push_back(branches[pick(uint32_t(branches.size()))]);
+                    body[i].push_back(uint8_t(skip));
+                }
+            }
+            for (const auto &op : body)
+                code.insert(code.end(), op.begin(), op.end());
+        }
+    };
+
+    struct Run
+    {
+        std::unique_ptr<Bus> bus = std::make_unique<Bus>();
+        std::shared_ptr<Cartridge> cart;
+
+        Run(std::shared_ptr<const RomImage> image, bool jit, uint64_t frames)
+        {
+            cart = std::make_shared<Cartridge>(std::move(image));
+            bus->insertCartridge(cart);
+            bus->cpu.connectBus(bus.get());
+            bus->cpu.reset();
+            bus->ppu.connectCartridge(cart);
+            bus->cpu.useRecompiler = jit;
+            play(*bus, {}, frames, 0);
+        }
+    };
+}
+
+int main(int argc, char **argv)
+{
+    int programs = argc > 1 ? atoi(argv[1]) : 24;
+    uint64_t frames = argc > 2 ? strtoull(argv[2], nullptr, 10) : 60;
+    uint32_t firstSeed = argc > 3 ? uint32_t(strtoul(argv[3], nullptr, 10)) : 1;
+
+    if (!CodeArena::available())
+    {
+        std::printf("JitDiff: no native backend on this host, skipping\n");
+        return 77;
+    }
+
+    int failed = 0;
+    size_t translated = 0;
+    for (uint32_t seed = firstSeed; seed < firstSeed + uint32_t(programs); seed++)
+    {
+        ProgramGen gen(seed);
+        std::shared_ptr<const RomImage> image = gen.build();
+        Run ref(image, false, frames);
+        Run jit(image, true, frames);
+        CPU6502 &a = ref.bus->cpu;
+        CPU6502 &b = jit.bus->cpu;
+
+        translated += std::count_if(b.compiled.begin(), b.compiled.end(),
+                                    [](const CPU6502::CompiledBlock &block) { return block.code != nullptr; });
+
+        std::string diff;
+        if (a.PC != b.PC || a.A != b.A || a.X != b.X || a.Y != b.Y || a.SP != b.SP ||
+            a.status.to_byte() != b.status.to_byte())
+        {
+            diff += "\n  interpreter: " + a.debugStr() + "  translator:  " + b.debugStr();
+        }
+        if (a.totalcycles != b.totalcycles)
+            diff += "\n  cycles " + std::to_string(a.totalcycles) + " vs " + std::to_string(b.totalcycles);
+        for (int addr = 0; addr < int(sizeof(ref.bus->CPUmem)); addr++)
+        {
+            if (ref.bus->CPUmem[addr] != jit.bus->CPUmem[addr])
+            {
+                char line[64];
+                std::snprintf(line, sizeof(line), "\n  RAM $%04X: %02X vs %02X", addr,
+                              ref.bus->CPUmem[addr], jit.bus->CPUmem[addr]);
+                diff += line;
+                break;
+            }
+        }
+        if (frameHash(ref.bus->ppu) != frameHash(jit.bus->ppu))
+            diff += "\n  frames differ";
+
+        if (!diff.empty())
+        {
+            std::printf("seed %u: translator differs after %llu frames:%s\n", seed,
+                        (unsigned long long)frames, diff.c_str());
+            failed++;
+        }
+    }
+
+    if (translated == 0)
+    {
+        std::printf("JitDiff: no block was translated\n");
+        return 1;
+    }
+    std::printf("JitDiff: %d/%d programs match over %llu frames (%zu blocks translated)\n",
+                programs - failed, programs, (unsigned long long)frames, translated);
+    return failed ? 1 : 0;
+}
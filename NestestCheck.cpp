@@ -0,0 +1,132 @@
+// Runs nestest.nes in automation mode ($C000) and compares CPU state with the
+// reference nestest.log line by line, stopping at the first mismatch.
+//
+//   NestestCheck nestest.nes nestest.log [--no-cache] [--jit]
+//
+// The log is the standard one:
+//   C000  4C F5 C5  JMP $C5F5        A:00 X:00 Y:00 P:24 SP:FD PPU:  0, 21 CYC:7
+// Only the CPU is stepped, so the PPU column is not checked.
+//
+// Exit codes: 0 pass, 1 mismatch or unreadable log, 77 (skipped) when the ROM
+// or log is missing.
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include "CPU6502.h"
+#include "Bus.h"
+
+// nestest.log counts the 7 cycles of the reset sequence before $C000
+static constexpr unsigned long long START_CYCLES = 7;
+
+struct LogState
+{
+    uint16_t pc;
+    uint8_t a, x, y, p, sp;
+    unsigned long long cyc;
+};
+
+static bool parseLine(const std::string &line, LogState &s)
+{
+    unsigned pc, a, x, y, p, sp;
+    const char *regs = strstr(line.c_str(), " A:");
+    const char *cyc = strstr(line.c_str(), " CYC:");
+    if (!regs || !cyc || sscanf(line.c_str(), "%4x", &pc) != 1 ||
+        sscanf(regs, " A:%2x X:%2x Y:%2x P:%2x SP:%2x", &a, &x, &y, &p, &sp) != 5 ||
+        sscanf(cyc, " CYC:%llu", &s.cyc) != 1)
+    {
+        return false;
+    }
+    s.pc = pc;
+    s.a = a;
+    s.x = x;
+    s.y = y;
+    s.p = p;
+    s.sp = sp;
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        std::cerr << "usage: NestestCheck nestest.nes nestest.log [--no-cache] [--jit]\n";
+        return 2;
+    }
+    bool jit = false;
+    bool cache = true;
+    for (int i = 3; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--jit") == 0)
+            jit = true;
+        else if (strcmp(argv[i], "--no-cache") == 0)
+            cache = false;
+    }
+
+    std::ifstream log(argv[2]);
+    auto cart = std::make_shared<Cartridge>(argv[1]);
+    if (!log || !cart->isImageValid())
+    {
+        std::cerr << "NestestCheck: " << argv[1] << " or " << argv[2] << " not found, skipping\n";
+        return 77;
+    }
+
+    auto bus = std::make_unique<Bus>();
+    bus->insertCartridge(cart);
+    CPU6502 &cpu = bus->cpu;
+    cpu.connectBus(bus.get());
+    cpu.reset();
+    cpu.PC = 0xC000;
+    cpu.cycles = 0;
+    cpu.totalcycles = START_CYCLES;
+    cpu.useDecodeCache = cache || jit;
+    cpu.useRecompiler = jit;
+    cpu.detectIdleLoops = false;
+
+    std::deque<std::string> context;
+    std::string line;
+    int lineNo = 0;
+    while (std::getline(log, line))
+    {
+        lineNo++;
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        if (line.empty())
+            continue;
+        LogState want;
+        if (!parseLine(line, want))
+        {
+            std::cout << "Unreadable log line " << lineNo << ": " << line << "\n";
+            return 1;
+        }
+
+        if (cpu.PC != want.pc || cpu.A != want.a || cpu.X != want.x || cpu.Y != want.y ||
+            cpu.status.to_byte() != want.p || cpu.SP != want.sp || cpu.totalcycles != want.cyc)
+        {
+            std::cout << "Mismatch at line " << lineNo << "\n";
+            for (const std::string &prev : context)
+                std::cout << "  " << prev << "\n";
+            std::cout << "  expected: " << line << "\n";
+            std::cout << "  actual:   " << cpu.debugStr();
+            return 1;
+        }
+
+        context.push_back(line);
+        if (context.size() > 8)
+            context.pop_front();
+
+        if (!jit || cpu.runCompiled(1) == 0)
+            cpu.step();
+    }
+
+    if (context.empty())
+    {
+        std::cout << "nestest: " << argv[2] << " has no log lines\n";
+        return 1;
+    }
+    std::cout << "nestest: " << lineNo << " lines match" << (jit ? " (jit)" : cache ? "" : " (no cache)") << "\n";
+    return 0;
+}
@@ -1,11 +1,17 @@
 #include "PPU2C02.h"
-#include "Cartridge.h"
+#include "CARTRIDGE.h"
 #include "Bus.h"
+#include "SaveState.h"
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 
 PPU2C02::PPU2C02()
 {
     primaryoam.fill(0xFF); // correct NES power-up state
+    mapNametables();
+    for (auto &row : framebuffer)
+        row.fill(0x0F); // black until something is drawn
 }
 
 void PPU2C02::connectBus(Bus *bus)
@@ -15,21 +21,18 @@ void PPU2C02::connectBus(Bus *bus)
 
 void PPU2C02::decodeTileToBuffer(uint8_t tile, uint8_t paletteIndex, uint32_t *outPixels)
 {
+    if (!cart)
+        return;
     uint16_t base = ppuctrl.spriteTbl ? 0x1000 : 0x0000;
-    uint16_t tileAddr = base + tile * 16;
+    const PatternTile &pattern = cart->patternTile(base + tile * 16);
 
     for (int y = 0; y < 8; y++)
 
     {
-        uint8_t lo = PPUread(tileAddr + y);
-        uint8_t hi = PPUread(tileAddr + y + 8);
-
         for (int x = 0; x < 8; x++)
 
         {
-            uint8_t bit0 = (lo >> (7 - x)) & 1;
-            uint8_t bit1 = (hi >> (7 - x)) & 1;
-            uint8_t pixel = (bit1 << 1) | bit0;
+            uint8_t pixel = pattern.rows[y][x];
 
             if (pixel == 0)
 
@@ -155,15 +158,18 @@ uint8_t PPU2C02::PPUread(uint16_t addr)
     if (addr <= 0x1FFF)
 
     {
-        if (cart && cart->PPUread(addr, data))
+        if (!cart)
+            return 0;
+        if (const uint8_t *page = cart->chrPage[(addr >> 10) & 0x07])
+            return page[addr & 0x03FF];
+        if (cart->PPUread(addr, data))
             return data;
         return 0;
     }
     else if (addr <= 0x3EFF)
 
     {
-        uint16_t idx = mapNametableAddr(addr);
-        return vram[idx];
+        return nametableByte(addr);
     }
     else
     {
@@ -193,8 +199,7 @@ void PPU2C02::PPUwrite(uint16_t addr, uint8_t data)
     else if (addr <= 0x3EFF)
 
     {
-        uint16_t idx = mapNametableAddr(addr);
-        vram[idx] = data;
+        nametableByte(addr) = data;
     }
     else
     {
@@ -221,6 +226,8 @@ void PPU2C02::debugOAMToTexture(uint32_t *outPixels, int w, int h)
     const int cell = 8; // each sprite cell is 8x8 pixels
     const int cols = 8; // 8 columns of sprites
     const int rows = 8; // 8 rows -> 64 entries
+    if (!cart)
+        return;
 
     for (int s = 0; s < 64; ++s)
 
@@ -241,36 +248,21 @@ void PPU2C02::debugOAMToTexture(uint32_t *outPixels, int w, int h)
         // For simplicity always use 8x8 fetch (if you support 8/16 you'd branch here)
         uint16_t tableBase = ppuctrl.spriteTbl ? 0x1000 : 0x0000;
         uint16_t tileAddr = tableBase + (uint16_t(tile) * 16);
-
-        // read 8 rows of pattern bytes
-        uint8_t pattern_lo[8];
-        uint8_t pattern_hi[8];
-        for (int y = 0; y < 8; ++y)
-
-        {
-            pattern_lo[y] = PPUread(tileAddr + y);
-            pattern_hi[y] = PPUread(tileAddr + y + 8);
-        }
+        const PatternTile &pattern = cart->patternTile(tileAddr);
 
         // palette index low bits come from attr & 0x03. Sprite palettes map to 4..7
         uint8_t palIndex = (attr & 0x03) + 4;
         // priority and hflip ignored for debug image, but we can show hflip
         bool hflip = (attr & 0x40) != 0;
+        const uint8_t(*patternRows)[8] = hflip ? pattern.flipped : pattern.rows;
 
         for (int py = 0; py < 8; ++py)
 
         {
-            uint8_t lo = pattern_lo[py];
-            uint8_t hi = pattern_hi[py];
             for (int px = 0; px < 8; ++px)
 
             {
-                int bit = 7 - px; // NES pattern bits, MSB = left
-                if (hflip)
-                    bit = px; // flip horizontally when requested
-                uint8_t p0 = (lo >> bit) & 1;
-                uint8_t p1 = (hi >> bit) & 1;
-                uint8_t colorIdx = (p1 << 1) | p0;
+                uint8_t colorIdx = patternRows[py][px];
 
                 uint32_t outColor;
                 if (inactive)
@@ -306,41 +298,17 @@ void PPU2C02::debugOAMToTexture(uint32_t *outPixels, int w, int h)
     }
 }
 
-uint16_t PPU2C02::mapNametableAddr(uint16_t addr) const
+void PPU2C02::mapNametables()
 {
-    uint16_t nt = (addr - 0x2000) & 0x0FFF;
-    uint16_t table = (nt / 0x0400) & 0x03;
-    uint16_t offset = nt & 0x03FF;
-    auto mir = cart ? cart->getMirror() : Cartridge::MIRROR::VERTICAL;
-    if (mir == Cartridge::MIRROR::FOUR_SCREEN)
-
-    {
-        vram.resize(4096);
-    }
-    uint16_t page = 0;
-    switch (mir)
-
+    if (cart)
     {
-    case Cartridge::MIRROR::VERTICAL:
-        page = table & 0x01;
-        break;
-
-    case Cartridge::MIRROR::HORIZONTAL:
-        page = table >> 1;
-        break;
-
-    case Cartridge::MIRROR::ONE_SCREEN_LO:
-        page = 0;
-        break;
-
-    case Cartridge::MIRROR::ONE_SCREEN_HI:
-        page = 1;
-        break;
-
-    case Cartridge::MIRROR::FOUR_SCREEN:
-        return nt;
+        cart->mapNametables(vram.data(), nametables);
+        ntMapVersion = cart->mapper ? cart->mapper->ntMapVersion() : 0;
+        return;
     }
-    return (page * 0x400) + offset;
+    // No cartridge: vertical mirroring
+    for (int i = 0; i < 4; i++)
+        nametables[i] = vram.data() + (i & 0x01) * 0x400;
 }
 
 uint16_t PPU2C02::incAmount()
@@ -369,9 +337,7 @@ void PPU2C02::getSpritePixel(uint8_t x, uint8_t &pixel, uint8_t &palette, bool &
         if (s.x_counter == 0)
 
         {
-            uint8_t p0 = (s.lo & 0x8000) ? 1 : 0;
-            uint8_t p1 = (s.hi & 0x8000) ? 1 : 0;
-            uint8_t sprPixel = (p1 << 1) | p0;
+            uint8_t sprPixel = s.shifted < 8 ? s.row[s.shifted] : 0;
 
             if (sprPixel != 0)
 
@@ -391,21 +357,36 @@ void PPU2C02::drawPixel(int x, int y, uint8_t palette, uint8_t pixel)
 {
     // pixel = background pattern index (0..3)
     // palette = attribute (0..3)
+    if (x == 0)
+    {
+        startLineEmphasis(y);
+    }
+    else if ((ppumask.value & 0xE0) != drawnEmphasis)
+    {
+        drawnEmphasis = ppumask.value & 0xE0;
+        emphasisChanges.push_back({uint8_t(y), uint8_t(x), drawnEmphasis});
+    }
     if (pixel == 0)
 
     {
         // Background color 0 uses universal background color.
-        uint8_t colorIndex = PPUread(0x3F00) & 0x3F;
-        auto rgb = systempalette[colorIndex];
-        framebuffer[y][x] = rgb;
+        framebuffer[y][x] = PPUread(0x3F00) & colorMask();
         return;
     }
 
     uint16_t addr = 0x3F00 | (palette << 2) | pixel;
-    uint8_t colorIndex = PPUread(addr) & 0x3F;
-    auto rgb = systempalette[colorIndex];
+    framebuffer[y][x] = PPUread(addr) & colorMask();
+}
 
-    framebuffer[y][x] = rgb;
+void PPU2C02::startLineEmphasis(int y)
+{
+    lineEmphasis[y] = drawnEmphasis = ppumask.value & 0xE0;
+    if (!emphasisChanges.empty())
+    {
+        emphasisChanges.erase(std::remove_if(emphasisChanges.begin(), emphasisChanges.end(),
+                                             [y](const EmphasisChange &c) { return c.y == y; }),
+                              emphasisChanges.end());
+    }
 }
 
 void PPU2C02::shiftBGShifters()
@@ -653,30 +634,23 @@ void PPU2C02::fetchSpriteTile(int dot)
     {
         uint16_t table = (entry.tile & 1) ? 0x1000 : 0x0000;
         uint8_t tileIndex = (entry.tile & 0xFE) + tileRow;
-        tileAddr = table + uint16_t(tileIndex) * 16 + fineY;
+        tileAddr = table + uint16_t(tileIndex) * 16;
     }
     else // 8*8
     {
         uint16_t table = ppuctrl.spriteTbl ? 0x1000 : 0x0000;
-        tileAddr = table + uint16_t(entry.tile) * 16 + fineY;
+        tileAddr = table + uint16_t(entry.tile) * 16;
     }
-    uint8_t lo = PPUread(tileAddr);
-    uint8_t hi = PPUread(tileAddr + 8);
-
-    if (entry.attr & 0x40) // Horizontal Flip
+    if (cart)
     {
-        auto reverse8 = [](uint8_t b)
-        {
-            b = (b & 0xF0) >> 4 | (b & 0x0F) << 4;
-            b = (b & 0xCC) >> 2 | (b & 0x33) << 2;
-            b = (b & 0xAA) >> 1 | (b & 0x55) << 1;
-            return b;
-        };
-        lo = reverse8(lo);
-        hi = reverse8(hi);
+        const PatternTile &pattern = cart->patternTile(tileAddr);
+        memcpy(sh.row, (entry.attr & 0x40) ? pattern.flipped[fineY] : pattern.rows[fineY], 8);
     }
-    sh.lo = uint16_t(lo) << 8;
-    sh.hi = uint16_t(hi) << 8;
+    else
+    {
+        memset(sh.row, 0, 8);
+    }
+    sh.shifted = 0;
     sh.x_counter = entry.x;
     sh.palette = (entry.attr & 0x03);
     sh.priority = (entry.attr & 0x20) ? 1 : 0;
@@ -696,10 +670,9 @@ void PPU2C02::shiftSpriteShifters()
         {
             s.x_counter--;
         }
-        else
+        else if (s.shifted < 8)
         {
-            s.lo <<= 1;
-            s.hi <<= 1;
+            s.shifted++;
         }
     }
 }
@@ -722,11 +695,10 @@ void PPU2C02::tick()
     {
         ppustatus.vblank = 1;
         ppustatus.to_byte();
-        if (ppuctrl.nmiEnable == 1 && !nmiOccurred)
+        if (ppuctrl.nmiEnable == 1 && !(bus->interrupts.pending & Bus::Interrupts::NMI))
 
         {
-            // Pass to bus which passes to cpu to nmi?
-            nmiOccurred = true;
+            bus->postNMI();
         }
     }
     else if (scanline_cycle == 261)
@@ -739,7 +711,7 @@ void PPU2C02::tick()
             ppustatus.spriteOverflow = 0;
             ppustatus.vblank = 0;
             ppustatus.to_byte();
-            nmiOccurred = false;
+            bus->interrupts.clear(Bus::Interrupts::NMI);
             frame_complete = true;
         }
         render_scanline();
@@ -760,6 +732,196 @@ void PPU2C02::tick()
     }
 }
 
+void PPU2C02::saveState(StateWriter &out) const
+{
+    PPUCTRL ctrl = ppuctrl;
+    PPUMASK mask = ppumask;
+    PPUSTATUS status = ppustatus;
+
+    out.bytes(vram.data(), vram.size());
+    out.put(palette);
+    out.put(primaryoam);
+    out.put(secondary_oam.data);
+    out.put(secondary_oam_index);
+    out.put(scanline_cycle);
+    out.put(dot);
+    out.put(frame_complete);
+    out.put(oddFrame);
+    out.put(ctrl.to_byte());
+    out.put(mask.to_byte());
+    out.put(status.to_byte());
+    out.put(oamaddr);
+    out.put(readBuffer);
+    out.put(v);
+    out.put(t);
+    out.put(x);
+    out.put(w);
+    out.put(bg_latch.nt);
+    out.put(bg_latch.at);
+    out.put(bg_latch.lo);
+    out.put(bg_latch.hi);
+    out.put(bg_shift.pattern_lo);
+    out.put(bg_shift.pattern_hi);
+    out.put(bg_shift.attrib_lo);
+    out.put(bg_shift.attrib_hi);
+    out.put(sprite_eval.n);
+    out.put(sprite_eval.m);
+    out.put(sprite_eval.latch);
+    out.put(sprite_eval.found);
+    out.put(sprite_eval.writesDisabled);
+    out.put(sprite_eval.copy);
+    out.put(sprite_eval.cycleGuard);
+    for (const SpriteFetchEntry &s : sprite_fetch)
+    {
+        out.put(s.y);
+        out.put(s.tile);
+        out.put(s.attr);
+        out.put(s.x);
+        out.put(s.valid);
+        out.put(s.isSpriteZero);
+    }
+    for (const SpriteShifter &s : sprite_shifters)
+    {
+        out.put(s.row);
+        out.put(s.shifted);
+        out.put(s.x_counter);
+        out.put(s.palette);
+        out.put(s.priority);
+        out.put(s.valid);
+        out.put(s.isSpriteZero);
+    }
+    out.put(spriteZeroInLine);
+    out.put(openBus);
+}
+
+void PPU2C02::loadState(StateReader &in)
+{
+    uint8_t ctrl, mask, status;
+
+    in.bytes(vram.data(), vram.size());
+    in.get(palette);
+    in.get(primaryoam);
+    in.get(secondary_oam.data);
+    in.get(secondary_oam_index);
+    in.get(scanline_cycle);
+    in.get(dot);
+    in.get(frame_complete);
+    in.get(oddFrame);
+    in.get(ctrl);
+    in.get(mask);
+    in.get(status);
+    in.get(oamaddr);
+    in.get(readBuffer);
+    in.get(v);
+    in.get(t);
+    in.get(x);
+    in.get(w);
+    in.get(bg_latch.nt);
+    in.get(bg_latch.at);
+    in.get(bg_latch.lo);
+    in.get(bg_latch.hi);
+    in.get(bg_shift.pattern_lo);
+    in.get(bg_shift.pattern_hi);
+    in.get(bg_shift.attrib_lo);
+    in.get(bg_shift.attrib_hi);
+    in.get(sprite_eval.n);
+    in.get(sprite_eval.m);
+    in.get(sprite_eval.latch);
+    in.get(sprite_eval.found);
+    in.get(sprite_eval.writesDisabled);
+    in.get(sprite_eval.copy);
+    in.get(sprite_eval.cycleGuard);
+    for (SpriteFetchEntry &s : sprite_fetch)
+    {
+        in.get(s.y);
+        in.get(s.tile);
+        in.get(s.attr);
+        in.get(s.x);
+        in.get(s.valid);
+        in.get(s.isSpriteZero);
+    }
+    for (SpriteShifter &s : sprite_shifters)
+    {
+        in.get(s.row);
+        in.get(s.shifted);
+        in.get(s.x_counter);
+        in.get(s.palette);
+        in.get(s.priority);
+        in.get(s.valid);
+        in.get(s.isSpriteZero);
+    }
+    in.get(spriteZeroInLine);
+    in.get(openBus);
+    ppuctrl.from_byte(ctrl);
+    ppumask.from_byte(mask);
+    ppustatus.from_byte(status);
+}
+
+bool PPU2C02::checkState(StateReader &in) const
+{
+    bool ok = true;
+    in.skip(vram.size() + sizeof(palette) + sizeof(primaryoam) + sizeof(secondary_oam.data) +
+            sizeof(secondary_oam_index));
+    ok &= in.within<int16_t>(-1, 261); // scanline_cycle
+    ok &= in.within<int16_t>(0, 340);  // dot
+    ok &= in.flag();                   // frame_complete
+    ok &= in.flag();                   // oddFrame
+    in.skip(5);                        // ctrl, mask, status, oamaddr, readBuffer
+    ok &= in.within<uint16_t>(0, 0x7FFF); // v
+    ok &= in.within<uint16_t>(0, 0x7FFF); // t
+    ok &= in.within<uint8_t>(0, 7);       // x
+    ok &= in.flag();                      // w
+    in.skip(1);                           // bg_latch.nt
+    ok &= in.within<uint8_t>(0, 3);       // bg_latch.at
+    in.skip(2 + sizeof(bg_shift.pattern_lo) * 4);
+    ok &= in.within<int>(0, 64); // sprite_eval.n
+    ok &= in.within<int>(0, 3);  // sprite_eval.m
+    in.skip(1);                  // sprite_eval.latch
+    ok &= in.within<int>(0, 8);  // sprite_eval.found
+    ok &= in.flag();             // sprite_eval.writesDisabled
+    in.skip(sizeof(sprite_eval.copy) + sizeof(sprite_eval.cycleGuard));
+    for (size_t i = 0; i < sprite_fetch.size(); i++)
+    {
+        in.skip(4); // y, tile, attr, x
+        ok &= in.flag();
+        ok &= in.flag();
+    }
+    for (size_t i = 0; i < sprite_shifters.size(); i++)
+    {
+        for (int k = 0; k < 8; k++)
+            ok &= in.within<uint8_t>(0, 3); // row
+        ok &= in.within<uint8_t>(0, 8);     // shifted
+        ok &= in.within<int>(0, 255);       // x_counter
+        ok &= in.within<uint8_t>(0, 3);     // palette
+        ok &= in.within<uint8_t>(0, 1);     // priority
+        ok &= in.flag();
+        ok &= in.flag();
+    }
+    ok &= in.flag(); // spriteZeroInLine
+    in.skip(1);      // openBus
+    return ok && in.ok();
+}
+
+uint32_t PPU2C02::dotsUntilEvent() const
+{
+    // The only PPU events the CPU can't observe through a register access are
+    // vblank/NMI at (241, 1) and frame completion at (261, 1).
+    const int frameDots = 262 * 341;
+    const int events[2] = {241 * 341 + 1, 261 * 341 + 1};
+    int pos = scanline_cycle * 341 + dot;
+    int best = frameDots;
+
+    for (int e : events)
+    {
+        int d = e - pos;
+        if (d < 0)
+            d += frameDots;
+        if (d < best)
+            best = d;
+    }
+    return best + 1; // +1 so the tick at the event dot itself has run
+}
+
 void PPU2C02::render_scanline()
 {
     if (!(ppumask.showBG || ppumask.showSprites) || dot == 0)
@@ -970,4 +1132,169 @@ void PPU2C02::render_scanline()
 
     if (preScanline && (dot >= 280 && dot <= 304))
         v = (v & 0x041F) | (t & 0x7BE0);
-}
\ No newline at end of file
+}
+
+bool PPU2C02::tickLine()
+{
+    if (!lineRenderer || !cart || dot != 0 || scanline_cycle < 0 || scanline_cycle > 239)
+        return false;
+
+    // With rendering off render_scanline() does nothing on a visible line
+    if (ppumask.showBG || ppumask.showSprites)
+        drawLine();
+    scanline_cycle++; // never wraps: the line after 239 is 240
+    return true;
+}
+
+void PPU2C02::fetchBGTile()
+{
+    bg_latch.nt = nametableByte(v);
+
+    uint8_t raw = nametableByte(0x23C0 | (v & 0x0C00) | ((v >> 4) & 0x38) | ((v >> 2) & 0x07));
+    int coarseX = (v & 0x001F);
+    int coarseY = (v & 0x03E0) >> 5;
+    int shift = ((coarseY & 2) << 1) | (coarseX & 2);
+    bg_latch.at = (raw >> shift) & 0x03;
+
+    uint16_t fineY = (v >> 12) & 0x07;
+    uint16_t tileAddr = (ppuctrl.bgTbl ? 0x1000 : 0x0000) + (bg_latch.nt << 4) + fineY;
+    bg_latch.lo = PPUread(tileAddr);
+    bg_latch.hi = PPUread(tileAddr + 8);
+    incrementScrollX();
+}
+
+void PPU2C02::drawLine()
+{
+    const int y = scanline_cycle;
+
+    // Background, as attribute << 2 | pixel. The shifters hold the two tiles
+    // prefetched at dots 321-336 of the previous line; dots 1-256 fetch 32
+    // more, loading one every 8 dots into a low byte that has just been shifted
+    // empty. So the shifters only ever show a stream of whole tiles, and pixel
+    // x is entry x + fine X of it.
+    uint8_t bg[34 * 8];
+    for (int i = 0; i < 16; i++)
+    {
+        int bit = 15 - i;
+        bg[i] = (((bg_shift.attrib_hi >> bit) & 1) << 3) | (((bg_shift.attrib_lo >> bit) & 1) << 2) |
+                (((bg_shift.pattern_hi >> bit) & 1) << 1) | ((bg_shift.pattern_lo >> bit) & 1);
+    }
+    const uint16_t fineY = (v >> 12) & 0x07; // coarse X is all that moves until dot 256
+    const uint16_t bgTable = ppuctrl.bgTbl ? 0x1000 : 0x0000;
+    TileFetch prev{};
+    for (int i = 2; i < 34; i++)
+    {
+        prev = bg_latch;
+        fetchBGTile();
+        uint64_t row;
+        memcpy(&row, cart->patternTile(bgTable + (bg_latch.nt << 4)).rows[fineY], 8);
+        row |= (bg_latch.at << 2) * 0x0101010101010101ull;
+        memcpy(bg + i * 8, &row, 8);
+    }
+
+    // Sprites fetched on the previous line. getSpritePixel() takes the lowest
+    // numbered opaque sprite, so a pixel, once set, stays.
+    uint8_t sprPixel[256] = {};
+    uint8_t sprPalette[256];
+    uint8_t sprPriority[256];
+    bool sprZero[256];
+    if (ppumask.showSprites)
+    {
+        for (const auto &s : sprite_shifters)
+        {
+            if (!s.valid)
+                continue;
+            for (int k = s.shifted; k < 8 && s.x_counter + k - s.shifted < 256; k++)
+            {
+                int px = s.x_counter + k - s.shifted;
+                uint8_t p = s.row[k];
+                if (p == 0 || sprPixel[px] != 0)
+                    continue;
+                sprPixel[px] = p;
+                sprPalette[px] = s.palette + 4;
+                sprPriority[px] = s.priority;
+                sprZero[px] = s.isSpriteZero;
+            }
+        }
+    }
+
+    // drawPixel() color for each palette << 2 | pixel
+    uint8_t colors[32];
+    for (int i = 0; i < 32; i++)
+        colors[i] = PPUread(0x3F00 | ((i & 0x03) ? i : 0)) & colorMask();
+    startLineEmphasis(y);
+
+    int hitDot = 0;
+    bool canHit = ppumask.showBG && ppumask.showSprites && ppustatus.spriteZeroHit == 0;
+    for (int px = 0; px < 256; px++)
+    {
+        uint8_t bgIndex = bg[px + x];
+        bool bgOpaque = ppumask.showBG && (bgIndex & 0x03) != 0 && (ppumask.showLeftBG || px >= 8);
+        bool sprOpaque = sprPixel[px] != 0 && (ppumask.showLeftSprites || px >= 8);
+
+        if (canHit && !hitDot && sprOpaque && bgOpaque && sprZero[px] && px < 255)
+            hitDot = px + 1;
+
+        uint8_t index = 0;
+        if (sprOpaque && (!bgOpaque || sprPriority[px] == 0))
+            index = (sprPalette[px] << 2) | sprPixel[px];
+        else if (bgOpaque)
+            index = bgIndex;
+        framebuffer[y][px] = colors[index];
+    }
+
+    // Where the shifters stand after dot 256: the last two fetched tiles in the
+    // background ones, every sprite counted down and shifted out.
+    bg_shift.pattern_lo = (prev.lo << 8) | bg_latch.lo;
+    bg_shift.pattern_hi = (prev.hi << 8) | bg_latch.hi;
+    bg_shift.attrib_lo = ((prev.at & 0x01) ? 0xFF00 : 0) | ((bg_latch.at & 0x01) ? 0x00FF : 0);
+    bg_shift.attrib_hi = ((prev.at & 0x02) ? 0xFF00 : 0) | ((bg_latch.at & 0x02) ? 0x00FF : 0);
+    for (auto &s : sprite_shifters)
+    {
+        if (!s.valid)
+            continue;
+        int shifts = 256 - std::min(s.x_counter, 256);
+        s.x_counter -= 256 - shifts;
+        s.shifted = uint8_t(std::min(s.shifted + shifts, 8));
+    }
+
+    // Sprite evaluation for the next line. PPUSTATUS.value is only refreshed
+    // when sprite 0 hits, so an overflow found later on the line must not show
+    // up in it: raise the hit between the same evaluation steps as tick() would.
+    secondary_oam.clear();
+    sprite_eval.n = 0;
+    sprite_eval.m = 0;
+    sprite_eval.latch = 0xFF;
+    sprite_eval.found = 0;
+    sprite_eval.writesDisabled = false;
+    secondary_oam_index.fill(0xFF);
+    for (int d = 1; d <= 256; d++)
+    {
+        if (d == hitDot)
+        {
+            ppustatus.spriteZeroHit = 1;
+            ppustatus.to_byte();
+        }
+        if (d >= 65)
+            spriteEvaluation(d);
+    }
+
+    incrementScrollY();
+    v = (v & 0x7BE0) | (t & 0x041F);
+    if (ppumask.showSprites)
+    {
+        for (int d = 257; d <= 320; d++)
+            fetchSpriteTile(d);
+    }
+
+    // Dots 321-336: prefetch the first two tiles of the next line
+    for (int i = 0; i < 2; i++)
+    {
+        bg_shift.pattern_lo <<= 8;
+        bg_shift.pattern_hi <<= 8;
+        bg_shift.attrib_lo <<= 8;
+        bg_shift.attrib_hi <<= 8;
+        fetchBGTile();
+        loadBGShifters();
+    }
+}
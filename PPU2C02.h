@@ -7,13 +7,15 @@
 class Bus;
 
 class Cartridge;
+class StateWriter;
+class StateReader;
 
 class PPU2C02 {
 public:
     Bus* bus = nullptr;
     PPU2C02(); 
     void connectBus(Bus* bus);
-    void connectCartridge(const std::shared_ptr<Cartridge>& c) { cart = c; }
+    void connectCartridge(const std::shared_ptr<Cartridge>& c) { cart = c; mapNametables(); }
 
     void    CPUwrite(uint16_t addr, uint8_t data);
     uint8_t CPUread(uint16_t addr);
@@ -21,7 +23,14 @@ public:
     uint8_t PPUread(uint16_t addr);
     void    PPUwrite(uint16_t addr, uint8_t data);
 
-    mutable std::vector<uint8_t> vram = std::vector<uint8_t>(2048); //2 x (Nametable(32*30 = 960 bytes) + Attribute Table(64 bytes)) = 2048. Info read from pattern table in cartridge   
+    std::array<uint8_t, 2048> vram{}; //2 x (Nametable(32*30 = 960 bytes) + Attribute Table(64 bytes)) = 2048. Info read from pattern table in cartridge   
+    // $2000-$2FFF in 1 KB pages, pointing into vram or cartridge nametable RAM.
+    // Only rewired by mapNametables(): on connectCartridge, after a state load
+    // and when the mapper's ntMapVersion() moves.
+    uint8_t *nametables[4];
+    uint32_t ntMapVersion = 0;
+    void mapNametables();
+    uint8_t &nametableByte(uint16_t addr) { return nametables[(addr >> 10) & 0x03][addr & 0x03FF]; }
     std::array<uint8_t, 0x20>  palette{}; //Frame Palette is eight groups of colors of four colors each.
     std::array<uint8_t, 256> primaryoam{};  //We have to work on this now. Seems like refreshed every frame and contains 64 sprites. Contans 4 things for a sprite(Byte 0: Y position (minus 1), Byte 1: Tile index, Byte 2: Attributes (palette, flipping, priority) ,Byte 3: X position)
     //Apart from that I believe only 8 sprites per frame loaded/evaluated from the SMB3 video by Bismuth. There are two oams in the system. The primary one listed above and the secondary one
@@ -54,13 +63,41 @@ public:
     Color{0xF8, 0xD8, 0x78}, Color{0xD8, 0xF8, 0x78}, Color{0xB8, 0xF8, 0xB8}, Color{0xB8, 0xF8, 0xD8},
     Color{0x00, 0xFC, 0xFC}, Color{0xF8, 0xD8, 0xF8}, Color{0x00, 0x00, 0x00}, Color{0x00, 0x00, 0x00}
     }; //Initialise NES system palette
-    std::array<std::array<Color, 256>, 240> framebuffer; //Store frame as array of pixels
+    // The picture as palette colors (0-63, greyscale already applied) plus the
+    // PPUMASK emphasis bits (5-7) each line started with. Conversion to RGB is
+    // left to the output stage, see FrameConvert.h.
+    //
+    // Emphasis is kept per line, not per pixel: the color byte has no room for
+    // three more bits. A $2001 write in the middle of a line already sends the
+    // line through the dot renderer, which notes each emphasis change there in
+    // emphasisChanges (in drawing order, x ascending within a line); pixels
+    // from x on take the new bits. A line drops its old changes when it is
+    // drawn again. Greyscale needs none of this, as it is part of the color.
+    struct EmphasisChange
+    {
+        uint8_t y;
+        uint8_t x;
+        uint8_t bits;
+    };
+    std::array<std::array<uint8_t, 256>, 240> framebuffer{};
+    std::array<uint8_t, 240> lineEmphasis{};
+    std::vector<EmphasisChange> emphasisChanges;
+    uint8_t colorMask() const { return ppumask.greyscale ? 0x30 : 0x3F; }
+
+    // ARGB for each emphasis and color, filled in by FrameConvert from
+    // systempalette and filled again whenever systempalette no longer matches
+    // the copy in source
+    struct OutputColors
+    {
+        std::array<Color, 64> source{};
+        bool valid = false;
+        uint32_t argb[8][64];
+    } outputColors;
    
     int16_t scanline_cycle = 0; // -1 pre-render, 0-239 visible, 240 post, 241-260 vblank
     int16_t dot = 0; // 0-340
     bool frame_complete = false; //Measure frame completion
     bool oddFrame = false;
-    bool nmiOccurred = false;
 
     //PPU Registers
     struct PPUCTRL {
@@ -213,9 +250,11 @@ public:
     };
     std::array<SpriteFetchEntry, 8> sprite_fetch;
 
+    // A fetched sprite row as decoded color indices, already flipped, and how
+    // many of its pixels have been shifted out
     struct SpriteShifter {
-        uint16_t lo = 0;
-        uint16_t hi = 0;
+        uint8_t row[8] = {};
+        uint8_t shifted = 0;
         int x_counter = 0;
         uint8_t palette = 0;
         uint8_t priority = 0;
@@ -227,13 +266,34 @@ public:
     bool spriteZeroInLine = false;
     uint8_t openBus = 0;
     std::shared_ptr<Cartridge> cart;
-    uint16_t mapNametableAddr(uint16_t addr) const; // apply mirroring
     uint16_t incAmount();
     void tick();
+    // Save state chunk: everything but the framebuffer, which is output only
+    void saveState(StateWriter &out) const;
+    void loadState(StateReader &in);
+    // Reads the chunk without applying it; false if a field that positions
+    // or indexes something (beam position, fine X, sprite evaluation,
+    // sprite shifters) or a bool is out of range
+    bool checkState(StateReader &in) const;
+    uint32_t dotsUntilEvent() const; // ticks until vblank/NMI or frame end is processed
     void debugOAMToTexture(uint32_t* out, int texW, int texH);
     void decodeTileToBuffer(uint8_t tile, uint8_t paletteIndex, uint32_t* outPixels);
     void render_scanline();
+    // Whole-line renderer. At dot 0 of a visible line, tickLine() does what 341
+    // tick() calls would (pixels, sprite evaluation and fetches, scroll updates)
+    // in one pass and returns true; anywhere else, or with lineRenderer off, it
+    // does nothing and returns false. It is only exact if nothing touches the
+    // PPU registers during the line, so Bus::syncPPU only calls it when the
+    // catch-up target lies past the line's last dot; a line with a register
+    // access in it falls back to tick(). Sprite 0 hit and overflow are raised
+    // in the same order as the dot renderer would raise them.
+    bool lineRenderer = true;
+    bool tickLine();
+    void drawLine();
+    void fetchBGTile(); // dot 1-7 of a tile fetch: nametable, attribute, pattern bytes, coarse X
     void drawPixel(int x, int y, uint8_t palette, uint8_t pixel);
+    void startLineEmphasis(int y);
+    uint8_t drawnEmphasis = 0; // emphasis of the last pixel drawn
     void shiftBGShifters();
     void loadBGShifters();
     void incrementScrollX();
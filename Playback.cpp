@@ -0,0 +1,99 @@
+#include "Playback.h"
+#include <fstream>
+#include "Bus.h"
+
+namespace
+{
+    // "RLDUTSBA": position i is button bit 7 - i, the same order as Bus::NESButtons
+    uint8_t parsePad(const std::string &field)
+    {
+        uint8_t buttons = 0;
+        for (size_t i = 0; i < field.size() && i < 8; i++)
+        {
+            if (field[i] != '.' && field[i] != ' ')
+                buttons |= 0x80 >> i;
+        }
+        return buttons;
+    }
+
+    void setPad(Bus &bus, int port, uint8_t buttons)
+    {
+        for (int bit = 0; bit < 8; bit++)
+            bus.setButton(port, static_cast<Bus::NESButtons>(1 << bit), buttons & (1 << bit));
+    }
+
+    uint64_t fnv1a(const void *data, size_t size, uint64_t hash = 0xCBF29CE484222325ull)
+    {
+        const uint8_t *p = static_cast<const uint8_t *>(data);
+        for (size_t i = 0; i < size; i++)
+            hash = (hash ^ p[i]) * 0x100000001B3ull;
+        return hash;
+    }
+}
+
+bool loadMovie(const std::string &path, std::vector<InputFrame> &frames)
+{
+    std::ifstream in(path);
+    if (!in)
+        return false;
+
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (line.empty() || line[0] != '|')
+            continue;
+        // Fields: commands, port 0, port 1, ...
+        std::vector<std::string> fields;
+        size_t at = 1;
+        while (at <= line.size())
+        {
+            size_t bar = line.find('|', at);
+            if (bar == std::string::npos)
+                bar = line.size();
+            fields.push_back(line.substr(at, bar - at));
+            at = bar + 1;
+        }
+        InputFrame frame{{0, 0}};
+        for (int port = 0; port < 2 && port + 1 < int(fields.size()); port++)
+            frame.pad[port] = parsePad(fields[port + 1]);
+        frames.push_back(frame);
+    }
+    return true;
+}
+
+PlaybackResult play(Bus &bus, const std::vector<InputFrame> &movie, uint64_t maxFrames, uint64_t maxCycles)
+{
+    if (!maxFrames)
+        maxFrames = UINT64_MAX;
+    if (!maxCycles)
+        maxCycles = UINT64_MAX;
+
+    uint64_t frames = 0;
+    uint64_t start = bus.cpu.totalcycles;
+    while (frames < maxFrames && bus.cpu.totalcycles - start < maxCycles)
+    {
+        InputFrame input = frames < movie.size() ? movie[frames] : InputFrame{{0, 0}};
+        setPad(bus, 0, input.pad[0]);
+        setPad(bus, 1, input.pad[1]);
+
+        while (!bus.ppu.frame_complete && bus.cpu.totalcycles - start < maxCycles)
+            bus.step();
+        if (!bus.ppu.frame_complete)
+            break;
+        bus.ppu.frame_complete = false;
+        frames++;
+    }
+    return {frames, bus.cpu.totalcycles - start};
+}
+
+uint64_t frameHash(const PPU2C02 &ppu)
+{
+    uint64_t hash = fnv1a(ppu.framebuffer.data(), sizeof(ppu.framebuffer));
+    hash = fnv1a(ppu.lineEmphasis.data(), sizeof(ppu.lineEmphasis), hash);
+    return fnv1a(ppu.emphasisChanges.data(), ppu.emphasisChanges.size() * sizeof(PPU2C02::EmphasisChange), hash);
+}
+
+uint64_t ramHash(const Bus &bus)
+{
+    return fnv1a(bus.CPUmem, sizeof(bus.CPUmem));
+}
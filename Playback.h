@@ -0,0 +1,36 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Bus;
+class PPU2C02;
+
+// Scripted runs for the headless frontend and the batch runner: movie input,
+// a frame/cycle-limited run loop and fingerprints of the result.
+//
+// Movies are FCEUX-style text. Every line starting with '|' is one frame,
+// "|commands|RLDUTSBA|RLDUTSBA|...", where any character other than '.' or
+// ' ' holds that button; other lines are header and ignored.
+struct InputFrame
+{
+    uint8_t pad[2];
+};
+
+bool loadMovie(const std::string &path, std::vector<InputFrame> &frames);
+
+struct PlaybackResult
+{
+    uint64_t frames;
+    uint64_t cycles; // CPU cycles
+};
+
+// Runs until maxFrames frames have completed or maxCycles CPU cycles have
+// passed (0 = no limit), setting the pads from movie at the start of each
+// frame. Past the end of the movie nothing is held.
+PlaybackResult play(Bus &bus, const std::vector<InputFrame> &movie, uint64_t maxFrames, uint64_t maxCycles);
+
+// FNV-1a of the framebuffer (colors, line emphasis and mid-line emphasis
+// changes) and of internal RAM
+uint64_t frameHash(const PPU2C02 &ppu);
+uint64_t ramHash(const Bus &bus);
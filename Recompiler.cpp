@@ -0,0 +1,1290 @@
+#include "Recompiler.h"
+#include "Bus.h"
+#include "CPU6502.h"
+#include <array>
+#include <cstring>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define SIMPLENES_NATIVE_X64 1
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#endif
+
+// CodeArena
+
+bool CodeArena::available()
+{
+#ifdef SIMPLENES_NATIVE_X64
+    return true;
+#else
+    return false;
+#endif
+}
+
+CodeArena::~CodeArena()
+{
+#ifdef SIMPLENES_NATIVE_X64
+    if (!base)
+        return;
+#ifdef _WIN32
+    VirtualFree(base, 0, MEM_RELEASE);
+#else
+    munmap(base, CAPACITY);
+#endif
+#endif
+}
+
+CodeArena::Entry CodeArena::add(const uint8_t *code, size_t size)
+{
+#ifdef SIMPLENES_NATIVE_X64
+    if (!base)
+    {
+#ifdef _WIN32
+        base = static_cast<uint8_t *>(VirtualAlloc(nullptr, CAPACITY, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+#else
+        void *p = mmap(nullptr, CAPACITY, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        base = p == MAP_FAILED ? nullptr : static_cast<uint8_t *>(p);
+#endif
+        if (!base)
+            return nullptr;
+    }
+    if (size > CAPACITY - used)
+        return nullptr;
+
+    // Only the pages the block lands on change protection
+    uint8_t *at = base + used;
+    size_t first = used & ~(PAGE - 1);
+    size_t span = ((used + size + PAGE - 1) & ~(PAGE - 1)) - first;
+#ifdef _WIN32
+    DWORD old;
+    if (!VirtualProtect(base + first, span, PAGE_READWRITE, &old))
+        return nullptr;
+    memcpy(at, code, size);
+    if (!VirtualProtect(base + first, span, PAGE_EXECUTE_READ, &old))
+        return nullptr;
+    FlushInstructionCache(GetCurrentProcess(), at, size);
+#else
+    if (mprotect(base + first, span, PROT_READ | PROT_WRITE) != 0)
+        return nullptr;
+    memcpy(at, code, size);
+    if (mprotect(base + first, span, PROT_READ | PROT_EXEC) != 0)
+        return nullptr;
+#endif
+    used += (size + 15) & ~size_t(15);
+    return reinterpret_cast<Entry>(at);
+#else
+    (void)code;
+    (void)size;
+    return nullptr;
+#endif
+}
+
+namespace
+{
+    // Just the x86-64 forms the translator uses. Memory operands always
+    // take a 32-bit displacement; byte registers are limited to those with
+    // a REX encoding (al, cl, dl, r8b-r11b) so ah-dh never come up.
+    enum Reg
+    {
+        RAX,
+        RCX,
+        RDX,
+        RBX,
+        RSP,
+        RBP,
+        RSI,
+        RDI,
+        R8,
+        R9,
+        R10,
+        R11,
+        R12,
+        R13,
+        R14,
+        R15,
+    };
+
+    enum Cond
+    {
+        CC_E = 0x4,
+        CC_NE = 0x5,
+        CC_BE = 0x6,
+        CC_AE = 0x3,
+        CC_LE = 0xE,
+    };
+
+    enum Alu
+    {
+        ADD = 0,
+        OR = 1,
+        AND = 4,
+        SUB = 5,
+        XOR = 6,
+        CMP = 7,
+    };
+
+    struct Mem
+    {
+        Reg base;
+        int32_t disp;
+        Reg index = RSP; // none
+        uint8_t scale = 1;
+    };
+
+#ifdef _WIN32
+    constexpr Reg ARG0 = RCX, ARG1 = RDX;
+#else
+    constexpr Reg ARG0 = RDI, ARG1 = RSI;
+#endif
+
+    class Assembler
+    {
+    public:
+        std::vector<uint8_t> code;
+
+        int newLabel()
+        {
+            labels.push_back({});
+            return int(labels.size() - 1);
+        }
+        bool used(int label) const { return !labels[label].uses.empty(); }
+        void bind(int label) { labels[label].pos = int(code.size()); }
+        void patch()
+        {
+            for (const Label &l : labels)
+            {
+                for (size_t at : l.uses)
+                {
+                    int32_t rel = int32_t(l.pos - int(at + 4));
+                    memcpy(&code[at], &rel, 4);
+                }
+            }
+        }
+
+        void movzxb(Reg d, Mem m) { op({0x0F, 0xB6}, d, m); }
+        void movzxb(Reg d, Reg s) { op({0x0F, 0xB6}, d, s, false, true); }
+        void movb(Mem m, Reg s) { op({0x88}, s, m, false, true); }
+        void movbi(Mem m, uint8_t v)
+        {
+            op({0xC6}, 0, m);
+            byte(v);
+        }
+        void movw(Mem m, Reg s)
+        {
+            byte(0x66);
+            op({0x89}, s, m);
+        }
+        void movwi(Mem m, uint16_t v)
+        {
+            byte(0x66);
+            op({0xC7}, 0, m);
+            byte(v & 0xFF);
+            byte(v >> 8);
+        }
+        void movq(Reg d, Mem m) { op({0x8B}, d, m, true); }
+        void mov(Reg d, Reg s) { op({0x89}, s, d); }
+        void movq(Reg d, Reg s) { op({0x89}, s, d, true); }
+        void movi(Reg d, uint32_t v)
+        {
+            rex(false, 0, 0, d);
+            byte(0xB8 + (d & 7));
+            dword(v);
+        }
+        void movqi(Reg d, uint64_t v)
+        {
+            rex(true, 0, 0, d);
+            byte(0xB8 + (d & 7));
+            dword(uint32_t(v));
+            dword(uint32_t(v >> 32));
+        }
+        void alu(Alu a, Reg d, Reg s) { op({uint8_t(a * 8 + 1)}, s, d); }
+        void alui(Alu a, Reg d, int32_t v)
+        {
+            if (v >= -128 && v <= 127)
+            {
+                op({0x83}, a, d);
+                byte(uint8_t(v));
+            }
+            else
+            {
+                op({0x81}, a, d);
+                dword(uint32_t(v));
+            }
+        }
+        void cmpbi(Mem m, uint8_t v)
+        {
+            op({0x80}, CMP, m);
+            byte(v);
+        }
+        void testbi(Mem m, uint8_t v)
+        {
+            op({0xF6}, 0, m);
+            byte(v);
+        }
+        void incd(Mem m) { op({0xFF}, 0, m); }
+        void shl(Reg d, uint8_t n)
+        {
+            op({0xC1}, 4, d);
+            byte(n);
+        }
+        void shr(Reg d, uint8_t n)
+        {
+            op({0xC1}, 5, d);
+            byte(n);
+        }
+        void notr(Reg d) { op({0xF7}, 2, d); }
+        void testq(Reg a, Reg b) { op({0x85}, b, a, true); }
+        void setcc(Cond c, Reg d) { op({0x0F, uint8_t(0x90 + c)}, 0, d, false, true); }
+        void jcc(Cond c, int label)
+        {
+            byte(0x0F);
+            byte(0x80 + c);
+            use(label);
+        }
+        void jmp(int label)
+        {
+            byte(0xE9);
+            use(label);
+        }
+        void push(Reg r)
+        {
+            rex(false, 0, 0, r);
+            byte(0x50 + (r & 7));
+        }
+        void pop(Reg r)
+        {
+            rex(false, 0, 0, r);
+            byte(0x58 + (r & 7));
+        }
+        void ret() { byte(0xC3); }
+
+    private:
+        struct Label
+        {
+            int pos = -1;
+            std::vector<size_t> uses;
+        };
+        std::vector<Label> labels;
+
+        void byte(uint8_t b) { code.push_back(b); }
+        void dword(uint32_t v)
+        {
+            for (int i = 0; i < 4; i++)
+                byte(uint8_t(v >> (8 * i)));
+        }
+        void use(int label)
+        {
+            labels[label].uses.push_back(code.size());
+            dword(0);
+        }
+        void rex(bool w, int r, int x, int b, bool force = false)
+        {
+            uint8_t prefix = 0x40 | (w << 3) | ((r & 8) >> 1) | ((x & 8) >> 2) | ((b & 8) >> 3);
+            if (prefix != 0x40 || force)
+                byte(prefix);
+        }
+        static bool needsRex(int r) { return r >= 4 && r < 8; } // spl-dil
+        void op(std::initializer_list<uint8_t> opcode, int r, Mem m, bool w = false, bool byteReg = false)
+        {
+            rex(w, r, m.index, m.base, byteReg && needsRex(r));
+            for (uint8_t b : opcode)
+                byte(b);
+            bool sib = m.index != RSP || (m.base & 7) == RSP;
+            byte(0x80 | (r & 7) << 3 | (sib ? 4 : (m.base & 7)));
+            if (sib)
+            {
+                uint8_t ss = m.scale == 8 ? 3 : m.scale == 4 ? 2 : m.scale == 2 ? 1 : 0;
+                byte(ss << 6 | (m.index & 7) << 3 | (m.base & 7));
+            }
+            dword(uint32_t(m.disp));
+        }
+        void op(std::initializer_list<uint8_t> opcode, int r, Reg rm, bool w = false, bool byteRegs = false)
+        {
+            rex(w, r, 0, rm, byteRegs && (needsRex(r) || needsRex(rm)));
+            for (uint8_t b : opcode)
+                byte(b);
+            byte(0xC0 | (r & 7) << 3 | (rm & 7));
+        }
+    };
+
+    // What the translator does with each opcode; None is left to the
+    // interpreter (BRK, KIL and the unofficial opcodes other than the NOPs)
+    enum class Kind : uint8_t
+    {
+        None,
+        LDA, LDX, LDY, STA, STX, STY,
+        ADC, SBC, AND, ORA, EOR, CMP, CPX, CPY, BIT,
+        ASL, LSR, ROL, ROR, INC, DEC,
+        ASL_A, LSR_A, ROL_A, ROR_A,
+        INX, INY, DEX, DEY, TAX, TAY, TXA, TYA, TSX, TXS,
+        CLC, SEC, CLI, SEI, CLD, SED, CLV, NOP,
+        PHA, PLA, PHP, PLP,
+        BCC, BCS, BEQ, BNE, BMI, BPL, BVC, BVS,
+        JMP, JSR, RTS, RTI,
+    };
+
+    const std::array<Kind, 256> kinds = []
+    {
+        using C = CPU6502;
+        static const struct
+        {
+            C::InstrFn fn;
+            Kind kind;
+        } map[] = {
+            {&C::LDA, Kind::LDA}, {&C::LDX, Kind::LDX}, {&C::LDY, Kind::LDY}, {&C::STA, Kind::STA},
+            {&C::STX, Kind::STX}, {&C::STY, Kind::STY}, {&C::ADC, Kind::ADC}, {&C::SBC, Kind::SBC},
+            {&C::AND, Kind::AND}, {&C::ORA, Kind::ORA}, {&C::EOR, Kind::EOR}, {&C::CMP, Kind::CMP},
+            {&C::CPX, Kind::CPX}, {&C::CPY, Kind::CPY}, {&C::BIT, Kind::BIT}, {&C::ASL, Kind::ASL},
+            {&C::LSR, Kind::LSR}, {&C::ROL, Kind::ROL}, {&C::ROR, Kind::ROR}, {&C::INC, Kind::INC},
+            {&C::DEC, Kind::DEC}, {&C::ASL_A, Kind::ASL_A}, {&C::LSR_A, Kind::LSR_A}, {&C::ROL_A, Kind::ROL_A},
+            {&C::ROR_A, Kind::ROR_A}, {&C::INX, Kind::INX}, {&C::INY, Kind::INY}, {&C::DEX, Kind::DEX},
+            {&C::DEY, Kind::DEY}, {&C::TAX, Kind::TAX}, {&C::TAY, Kind::TAY}, {&C::TXA, Kind::TXA},
+            {&C::TYA, Kind::TYA}, {&C::TSX, Kind::TSX}, {&C::TXS, Kind::TXS}, {&C::CLC, Kind::CLC},
+            {&C::SEC, Kind::SEC}, {&C::CLI, Kind::CLI}, {&C::SEI, Kind::SEI}, {&C::CLD, Kind::CLD},
+            {&C::SED, Kind::SED}, {&C::CLV, Kind::CLV}, {&C::NOP, Kind::NOP}, {&C::IGN, Kind::NOP},
+            {&C::PHA, Kind::PHA}, {&C::PLA, Kind::PLA}, {&C::PHP, Kind::PHP}, {&C::PLP, Kind::PLP},
+            {&C::BCC, Kind::BCC}, {&C::BCS, Kind::BCS}, {&C::BEQ, Kind::BEQ}, {&C::BNE, Kind::BNE},
+            {&C::BMI, Kind::BMI}, {&C::BPL, Kind::BPL}, {&C::BVC, Kind::BVC}, {&C::BVS, Kind::BVS},
+            {&C::JMP, Kind::JMP}, {&C::JSR, Kind::JSR}, {&C::RTS, Kind::RTS}, {&C::RTI, Kind::RTI},
+        };
+        std::array<Kind, 256> table{};
+        for (int op = 0; op < 256; op++)
+        {
+            for (const auto &m : map)
+            {
+                if (C::lookup[op].operate == m.fn)
+                    table[op] = m.kind;
+            }
+        }
+        return table;
+    }();
+
+    // Emits one block. Guest state stays in the CPU6502 object: rbx points at
+    // it, r12 at the Bus and r13d holds the cycle budget left. Each
+    // instruction does all of its checks before it changes anything, so a
+    // bail-out leaves the machine exactly at that instruction.
+    class BlockCompiler
+    {
+    public:
+        BlockCompiler(CPU6502 &cpu, const CPU6502::CodeBlock &block) : cpu(cpu), bus(*cpu.bus), block(block) {}
+
+        // Returns the number of instructions translated, a prefix of the
+        // block; idleSafe is set if all of them are idle-safe
+        int compile(bool &idleSafe);
+        const std::vector<uint8_t> &code() const { return a.code; }
+        uint16_t lastPC() const { return pcs[count - 1]; }
+
+    private:
+        CPU6502 &cpu;
+        Bus &bus;
+        const CPU6502::CodeBlock &block;
+        Assembler a;
+        int exits[CPU6502::MAX_BLOCK_OPS + 1];
+        uint16_t pcs[CPU6502::MAX_BLOCK_OPS + 1];
+        int exitDone = 0; // PC already stored, every instruction completed
+        int epilogue = 0;
+        int body = 0;     // the first instruction, after the prologue
+        int count = 0;
+
+        Mem cpuField(const void *field) const
+        {
+            return {RBX, int32_t(static_cast<const uint8_t *>(field) - reinterpret_cast<const uint8_t *>(&cpu))};
+        }
+        Mem busField(const void *field, Reg index = RSP, uint8_t scale = 1) const
+        {
+            return {R12, int32_t(static_cast<const uint8_t *>(field) - reinterpret_cast<const uint8_t *>(&bus)), index,
+                    scale};
+        }
+        Mem reg(const uint8_t &r) const { return cpuField(&r); }
+        Mem ram(uint16_t offset, Reg index = RSP) const { return busField(&bus.CPUmem[offset], index); }
+        Mem ramGen(int page) const { return cpuField(&cpu.ramGen[page]); }
+
+        bool isRAM(const uint8_t *page, int n) const { return page == &bus.CPUmem[(n << 8) & 0x07FF]; }
+        bool ramPage(int n) const { return isRAM(bus.readPage[n], n) && isRAM(bus.writePage[n], n); }
+        bool translatable(const CPU6502::DecodedOp &op, uint16_t pc) const;
+
+        int exitAt(int k)
+        {
+            if (exits[k] < 0)
+                exits[k] = a.newLabel();
+            return exits[k];
+        }
+        void setNZ(Reg v)
+        {
+            a.movb(reg(cpu.status.zres), v);
+            a.movb(reg(cpu.status.nres), v);
+        }
+        void charge(int cycles, bool penalty = false)
+        {
+            if (penalty)
+                a.alu(SUB, R13, R9);
+            a.alui(SUB, R13, cycles);
+        }
+        void operandAddress(const CPU6502::DecodedOp &op, bool penalty);
+        void readDynamic(int k);
+        void checkWrite(int k);
+        void storeDynamic(Reg v);
+        void loadOperand(int k, const CPU6502::DecodedOp &op, bool penalty);
+        void modify(Kind kind, Reg v);
+        void push(Reg v);
+        void pop(Reg d);
+        void packStatus();
+        void unpackStatus(Reg v);
+        void checkIRQ(int k);
+        void jumpTo(uint16_t target, int cycles, bool chain);
+        void jumpDynamic(int cycles);
+        bool emit(int k, const CPU6502::DecodedOp &op, uint16_t pc, bool chain);
+    };
+
+    bool BlockCompiler::translatable(const CPU6502::DecodedOp &op, uint16_t pc) const
+    {
+        Kind kind = kinds[op.opcode];
+        if (kind == Kind::None)
+            return false;
+
+        const CPU6502::instruction &ins = CPU6502::lookup[op.opcode];
+        uint16_t operand = op.lo | (op.hi << 8);
+        bool writes = CPU6502::writesMemory(op.opcode);
+        (void)pc;
+
+        // The stack is always internal RAM, but check the map says so
+        switch (kind)
+        {
+        case Kind::PHA:
+        case Kind::PLA:
+        case Kind::PHP:
+        case Kind::PLP:
+        case Kind::JSR:
+        case Kind::RTS:
+        case Kind::RTI:
+            if (!ramPage(0x01))
+                return false;
+            break;
+        case Kind::NOP:
+            // Unofficial NOPs don't read their operand on FastBus, but one
+            // aimed at I/O matters to idle-loop detection
+            if (ins.addressing != CPU6502::Addressing::ABS)
+                return true;
+            break;
+        default:
+            break;
+        }
+
+        switch (ins.addressing)
+        {
+        case CPU6502::Addressing::ZP0:
+        case CPU6502::Addressing::ZPX:
+        case CPU6502::Addressing::ZPY:
+        case CPU6502::Addressing::IZX:
+        case CPU6502::Addressing::IZY:
+            return ramPage(0x00);
+        case CPU6502::Addressing::ABS:
+            if (kind == Kind::JMP || kind == Kind::JSR)
+                return true;
+            // Fixed addresses are settled now: I/O and anything else off the
+            // page table stays with the interpreter
+            return writes ? bus.writePage[operand >> 8] != nullptr : bus.readPage[operand >> 8] != nullptr;
+        case CPU6502::Addressing::IND:
+            return bus.readPage[operand >> 8] != nullptr;
+        default:
+            return true;
+        }
+    }
+
+    // Address of an indexed or indirect operand into ecx, and the page-cross
+    // penalty (0 or 1) into r9d when the opcode has one
+    void BlockCompiler::operandAddress(const CPU6502::DecodedOp &op, bool penalty)
+    {
+        uint16_t operand = op.lo | (op.hi << 8);
+        switch (CPU6502::lookup[op.opcode].addressing)
+        {
+        case CPU6502::Addressing::ABX:
+        case CPU6502::Addressing::ABY:
+            a.movzxb(RCX, reg(CPU6502::lookup[op.opcode].addressing == CPU6502::Addressing::ABX ? cpu.X : cpu.Y));
+            a.alui(ADD, RCX, operand);
+            a.alui(AND, RCX, 0xFFFF);
+            if (penalty)
+            {
+                a.mov(R9, RCX);
+                a.shr(R9, 8);
+                a.alui(CMP, R9, operand >> 8);
+                a.setcc(CC_NE, R9);
+                a.movzxb(R9, R9);
+            }
+            break;
+        case CPU6502::Addressing::IZX:
+            a.movzxb(RDX, reg(cpu.X));
+            a.alui(ADD, RDX, op.lo);
+            a.alui(AND, RDX, 0xFF);
+            a.movzxb(RAX, ram(0, RDX));
+            a.alui(ADD, RDX, 1);
+            a.alui(AND, RDX, 0xFF);
+            a.movzxb(RCX, ram(0, RDX));
+            a.shl(RCX, 8);
+            a.alu(OR, RCX, RAX);
+            break;
+        case CPU6502::Addressing::IZY:
+            a.movzxb(RCX, ram(op.lo));
+            a.movzxb(RAX, ram((op.lo + 1) & 0xFF));
+            a.shl(RAX, 8);
+            a.alu(OR, RCX, RAX);
+            if (penalty)
+            {
+                a.mov(R9, RCX);
+                a.shr(R9, 8);
+            }
+            a.movzxb(RDX, reg(cpu.Y));
+            a.alu(ADD, RCX, RDX);
+            a.alui(AND, RCX, 0xFFFF);
+            if (penalty)
+            {
+                a.mov(RDX, RCX);
+                a.shr(RDX, 8);
+                a.alu(CMP, RDX, R9);
+                a.setcc(CC_NE, R9);
+                a.movzxb(R9, R9);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    // Byte at ecx into eax through Bus::readPage; an unmapped page (I/O,
+    // mapper registers) bails out before instruction k
+    void BlockCompiler::readDynamic(int k)
+    {
+        a.mov(RDX, RCX);
+        a.shr(RDX, 8);
+        a.movq(RAX, busField(bus.readPage, RDX, 8));
+        a.testq(RAX, RAX);
+        a.jcc(CC_E, exitAt(k));
+        a.movzxb(RDX, RCX);
+        a.movzxb(RAX, Mem{RAX, 0, RDX, 1});
+    }
+
+    // Page pointer for a write to ecx into rax; only internal RAM has one
+    void BlockCompiler::checkWrite(int k)
+    {
+        a.mov(RDX, RCX);
+        a.shr(RDX, 8);
+        a.movq(RAX, busField(bus.writePage, RDX, 8));
+        a.testq(RAX, RAX);
+        a.jcc(CC_E, exitAt(k));
+    }
+
+    void BlockCompiler::storeDynamic(Reg v)
+    {
+        a.movzxb(RDX, RCX);
+        a.movb(Mem{RAX, 0, RDX, 1}, v);
+        a.mov(RDX, RCX);
+        a.alui(AND, RDX, 0x07FF);
+        a.shr(RDX, 8);
+        a.incd(Mem{RBX, cpuField(&cpu.ramGen[0]).disp, RDX, 4});
+    }
+
+    // Operand value of a read instruction into eax
+    void BlockCompiler::loadOperand(int k, const CPU6502::DecodedOp &op, bool penalty)
+    {
+        uint16_t operand = op.lo | (op.hi << 8);
+        switch (CPU6502::lookup[op.opcode].addressing)
+        {
+        case CPU6502::Addressing::IMM:
+            a.movi(RAX, op.lo);
+            break;
+        case CPU6502::Addressing::ZP0:
+            a.movzxb(RAX, ram(op.lo));
+            break;
+        case CPU6502::Addressing::ZPX:
+        case CPU6502::Addressing::ZPY:
+            a.movzxb(RDX, reg(CPU6502::lookup[op.opcode].addressing == CPU6502::Addressing::ZPX ? cpu.X : cpu.Y));
+            a.alui(ADD, RDX, op.lo);
+            a.alui(AND, RDX, 0xFF);
+            a.movzxb(RAX, ram(0, RDX));
+            break;
+        case CPU6502::Addressing::ABS:
+        {
+            const uint8_t *page = bus.readPage[operand >> 8];
+            if (isRAM(page, operand >> 8))
+                a.movzxb(RAX, ram(operand & 0x07FF));
+            else
+                a.movi(RAX, page[operand & 0xFF]); // ROM: fixed until the next mapper write
+            break;
+        }
+        default:
+            operandAddress(op, penalty);
+            readDynamic(k);
+            break;
+        }
+    }
+
+    // Read-modify-write on the byte in v (zero-extended); the result is in
+    // the low byte of v
+    void BlockCompiler::modify(Kind kind, Reg v)
+    {
+        Mem c = reg(cpu.status.c);
+        switch (kind)
+        {
+        case Kind::ASL:
+        case Kind::ASL_A:
+            a.mov(R10, v);
+            a.shr(R10, 7);
+            a.movb(c, R10);
+            a.shl(v, 1);
+            break;
+        case Kind::LSR:
+        case Kind::LSR_A:
+            a.mov(R10, v);
+            a.alui(AND, R10, 1);
+            a.movb(c, R10);
+            a.shr(v, 1);
+            break;
+        case Kind::ROL:
+        case Kind::ROL_A:
+            a.movzxb(R11, c);
+            a.mov(R10, v);
+            a.shr(R10, 7);
+            a.movb(c, R10);
+            a.shl(v, 1);
+            a.alu(OR, v, R11);
+            break;
+        case Kind::ROR:
+        case Kind::ROR_A:
+            a.movzxb(R11, c);
+            a.mov(R10, v);
+            a.alui(AND, R10, 1);
+            a.movb(c, R10);
+            a.shr(v, 1);
+            a.shl(R11, 7);
+            a.alu(OR, v, R11);
+            break;
+        case Kind::INC:
+            a.alui(ADD, v, 1);
+            break;
+        case Kind::DEC:
+            a.alui(SUB, v, 1);
+            break;
+        default:
+            break;
+        }
+    }
+
+    void BlockCompiler::push(Reg v)
+    {
+        a.movzxb(RDX, reg(cpu.SP));
+        a.movb(ram(0x0100, RDX), v);
+        a.alui(SUB, RDX, 1);
+        a.movb(reg(cpu.SP), RDX);
+        a.incd(ramGen(1));
+    }
+
+    void BlockCompiler::pop(Reg d)
+    {
+        a.movzxb(RDX, reg(cpu.SP));
+        a.alui(ADD, RDX, 1);
+        a.alui(AND, RDX, 0xFF);
+        a.movb(reg(cpu.SP), RDX);
+        a.movzxb(d, ram(0x0100, RDX));
+    }
+
+    // Status::to_byte() into eax (and status.value)
+    void BlockCompiler::packStatus()
+    {
+        CPU6502::Status &p = cpu.status;
+        a.movzxb(RAX, reg(p.c));
+        a.cmpbi(reg(p.zres), 0);
+        a.setcc(CC_E, RDX);
+        a.movzxb(RDX, RDX);
+        a.shl(RDX, 1);
+        a.alu(OR, RAX, RDX);
+        uint8_t *bits[] = {&p.i, &p.d, &p.B, &p.u};
+        for (int n = 0; n < 4; n++)
+        {
+            a.movzxb(RDX, reg(*bits[n]));
+            a.shl(RDX, 2 + n);
+            a.alu(OR, RAX, RDX);
+        }
+        a.movzxb(RDX, reg(p.vres));
+        a.shr(RDX, 7);
+        a.shl(RDX, 6);
+        a.alu(OR, RAX, RDX);
+        a.movzxb(RDX, reg(p.nres));
+        a.alui(AND, RDX, 0x80);
+        a.alu(OR, RAX, RDX);
+        a.movb(reg(p.value), RAX);
+    }
+
+    // Status::from_byte() of the byte in v
+    void BlockCompiler::unpackStatus(Reg v)
+    {
+        CPU6502::Status &p = cpu.status;
+        a.movb(reg(p.value), v);
+        uint8_t *bits[] = {&p.c, &p.zres, &p.i, &p.d, &p.B, &p.u};
+        for (int n = 0; n < 6; n++)
+        {
+            a.mov(RDX, v);
+            if (n)
+                a.shr(RDX, n);
+            a.alui(AND, RDX, 1);
+            if (bits[n] == &p.zres)
+                a.alui(XOR, RDX, 1);
+            a.movb(reg(*bits[n]), RDX);
+        }
+        a.mov(RDX, v);
+        a.alui(AND, RDX, 0x40);
+        a.shl(RDX, 1);
+        a.movb(reg(p.vres), RDX);
+        a.mov(RDX, v);
+        a.alui(AND, RDX, 0x80);
+        a.movb(reg(p.nres), RDX);
+    }
+
+    // After CLI or PLP: an IRQ line held while I was set is taken before the
+    // next instruction, so leave through exit k if it is now unmasked
+    void BlockCompiler::checkIRQ(int k)
+    {
+        int masked = a.newLabel();
+        a.cmpbi(reg(cpu.status.i), 0);
+        a.jcc(CC_NE, masked);
+        a.testbi(busField(&bus.interrupts.pending), Bus::Interrupts::IRQ);
+        a.jcc(CC_NE, exitAt(k));
+        a.bind(masked);
+    }
+
+    // Leaves the block for a fixed target. A block that jumps back to its own
+    // start loops in native code while budget lasts, unless it could be an
+    // idle loop: runCompiled() has to see those go round.
+    void BlockCompiler::jumpTo(uint16_t target, int cycles, bool chain)
+    {
+        a.alui(SUB, R13, cycles);
+        if (chain && target == block.pc)
+        {
+            int out = a.newLabel();
+            a.jcc(CC_LE, out);
+            a.jmp(body);
+            a.bind(out);
+        }
+        a.movwi(cpuField(&cpu.PC), target);
+        a.jmp(exitDone);
+    }
+
+    // Leaves the block for the address in ecx
+    void BlockCompiler::jumpDynamic(int cycles)
+    {
+        a.alui(SUB, R13, cycles);
+        a.movw(cpuField(&cpu.PC), RCX);
+        a.jmp(exitDone);
+    }
+
+    // Emits instruction k; returns true if it transfers control (and so has
+    // left the block itself)
+    bool BlockCompiler::emit(int k, const CPU6502::DecodedOp &op, uint16_t pc, bool chain)
+    {
+        using Mode = CPU6502::Addressing;
+        const CPU6502::instruction &ins = CPU6502::lookup[op.opcode];
+        Kind kind = kinds[op.opcode];
+        Mode mode = ins.addressing;
+        uint16_t operand = op.lo | (op.hi << 8);
+        uint16_t next = pc + op.length;
+        bool penalty = ins.pagePenalty && (mode == Mode::ABX || mode == Mode::ABY || mode == Mode::IZY);
+        Mem A = reg(cpu.A), X = reg(cpu.X), Y = reg(cpu.Y);
+        CPU6502::Status &p = cpu.status;
+
+        switch (kind)
+        {
+        case Kind::LDA:
+        case Kind::LDX:
+        case Kind::LDY:
+            loadOperand(k, op, penalty);
+            a.movb(kind == Kind::LDA ? A : kind == Kind::LDX ? X : Y, RAX);
+            setNZ(RAX);
+            break;
+
+        case Kind::AND:
+        case Kind::ORA:
+        case Kind::EOR:
+            loadOperand(k, op, penalty);
+            a.movzxb(RDX, A);
+            a.alu(kind == Kind::AND ? AND : kind == Kind::ORA ? OR : XOR, RAX, RDX);
+            a.movb(A, RAX);
+            setNZ(RAX);
+            break;
+
+        case Kind::ADC:
+            loadOperand(k, op, penalty);
+            a.movzxb(RDX, A);
+            a.movzxb(R8, reg(p.c));
+            a.mov(R10, RDX); // temp = A + m + c
+            a.alu(ADD, R10, RAX);
+            a.alu(ADD, R10, R8);
+            a.mov(R8, R10);
+            a.shr(R8, 8);
+            a.movb(reg(p.c), R8);
+            a.mov(R11, RDX); // vres = ~(A ^ m) & (A ^ temp)
+            a.alu(XOR, R11, RAX);
+            a.notr(R11);
+            a.alu(XOR, RDX, R10);
+            a.alu(AND, R11, RDX);
+            a.movb(reg(p.vres), R11);
+            a.movb(A, R10);
+            setNZ(R10);
+            break;
+
+        case Kind::SBC:
+            loadOperand(k, op, penalty);
+            a.movzxb(RDX, A);
+            a.movzxb(R8, reg(p.c));
+            a.alui(XOR, R8, 1);
+            a.mov(R10, RDX); // diff = A - m - borrow, 16 bits
+            a.alu(SUB, R10, RAX);
+            a.alu(SUB, R10, R8);
+            a.alui(AND, R10, 0xFFFF);
+            a.alui(CMP, R10, 0xFF);
+            a.setcc(CC_BE, R8);
+            a.movb(reg(p.c), R8);
+            a.mov(R11, RAX); // vres = (A ^ diff) & (~m ^ diff)
+            a.notr(R11);
+            a.alu(XOR, R11, R10);
+            a.alu(XOR, RDX, R10);
+            a.alu(AND, R11, RDX);
+            a.movb(reg(p.vres), R11);
+            a.movb(A, R10);
+            setNZ(R10);
+            break;
+
+        case Kind::CMP:
+        case Kind::CPX:
+        case Kind::CPY:
+            loadOperand(k, op, penalty);
+            a.movzxb(RDX, kind == Kind::CMP ? A : kind == Kind::CPX ? X : Y);
+            a.mov(R10, RDX);
+            a.alu(SUB, R10, RAX);
+            a.alu(CMP, RDX, RAX);
+            a.setcc(CC_AE, R8);
+            a.movb(reg(p.c), R8);
+            setNZ(R10);
+            break;
+
+        case Kind::BIT:
+            loadOperand(k, op, penalty);
+            a.movzxb(RDX, A);
+            a.alu(AND, RDX, RAX);
+            a.movb(reg(p.zres), RDX);
+            a.mov(R10, RAX);
+            a.shl(R10, 1);
+            a.movb(reg(p.vres), R10);
+            a.movb(reg(p.nres), RAX);
+            break;
+
+        case Kind::STA:
+        case Kind::STX:
+        case Kind::STY:
+        {
+            Mem src = kind == Kind::STA ? A : kind == Kind::STX ? X : Y;
+            switch (mode)
+            {
+            case Mode::ZP0:
+                a.movzxb(RAX, src);
+                a.movb(ram(op.lo), RAX);
+                a.incd(ramGen(0));
+                break;
+            case Mode::ZPX:
+            case Mode::ZPY:
+                a.movzxb(RDX, mode == Mode::ZPX ? X : Y);
+                a.alui(ADD, RDX, op.lo);
+                a.alui(AND, RDX, 0xFF);
+                a.movzxb(RAX, src);
+                a.movb(ram(0, RDX), RAX);
+                a.incd(ramGen(0));
+                break;
+            case Mode::ABS:
+                a.movzxb(RAX, src);
+                a.movb(ram(operand & 0x07FF), RAX);
+                a.incd(ramGen((operand & 0x07FF) >> 8));
+                break;
+            default:
+                operandAddress(op, false);
+                checkWrite(k);
+                a.movzxb(R8, src);
+                storeDynamic(R8);
+                break;
+            }
+            break;
+        }
+
+        case Kind::ASL:
+        case Kind::LSR:
+        case Kind::ROL:
+        case Kind::ROR:
+        case Kind::INC:
+        case Kind::DEC:
+            switch (mode)
+            {
+            case Mode::ZP0:
+            case Mode::ABS:
+            {
+                uint16_t offset = mode == Mode::ZP0 ? op.lo : operand & 0x07FF;
+                a.movzxb(RAX, ram(offset));
+                modify(kind, RAX);
+                a.movb(ram(offset), RAX);
+                a.incd(ramGen(offset >> 8));
+                setNZ(RAX);
+                break;
+            }
+            case Mode::ZPX:
+                a.movzxb(RDX, X);
+                a.alui(ADD, RDX, op.lo);
+                a.alui(AND, RDX, 0xFF);
+                a.movzxb(RAX, ram(0, RDX));
+                modify(kind, RAX);
+                a.movb(ram(0, RDX), RAX);
+                a.incd(ramGen(0));
+                setNZ(RAX);
+                break;
+            default:
+                operandAddress(op, false);
+                checkWrite(k);
+                a.movzxb(RDX, RCX);
+                a.movzxb(R8, Mem{RAX, 0, RDX, 1});
+                modify(kind, R8);
+                storeDynamic(R8);
+                setNZ(R8);
+                break;
+            }
+            break;
+
+        case Kind::ASL_A:
+        case Kind::LSR_A:
+        case Kind::ROL_A:
+        case Kind::ROR_A:
+            a.movzxb(RAX, A);
+            modify(kind, RAX);
+            a.movb(A, RAX);
+            setNZ(RAX);
+            break;
+
+        case Kind::INX:
+        case Kind::INY:
+        case Kind::DEX:
+        case Kind::DEY:
+        {
+            Mem r = kind == Kind::INX || kind == Kind::DEX ? X : Y;
+            a.movzxb(RAX, r);
+            a.alui(kind == Kind::INX || kind == Kind::INY ? ADD : SUB, RAX, 1);
+            a.movb(r, RAX);
+            setNZ(RAX);
+            break;
+        }
+
+        case Kind::TAX:
+        case Kind::TAY:
+        case Kind::TXA:
+        case Kind::TYA:
+        case Kind::TSX:
+        case Kind::TXS:
+        {
+            static const struct
+            {
+                Kind kind;
+                uint8_t CPU6502::*from, CPU6502::*to;
+            } moves[] = {{Kind::TAX, &CPU6502::A, &CPU6502::X}, {Kind::TAY, &CPU6502::A, &CPU6502::Y},
+                         {Kind::TXA, &CPU6502::X, &CPU6502::A}, {Kind::TYA, &CPU6502::Y, &CPU6502::A},
+                         {Kind::TSX, &CPU6502::SP, &CPU6502::X}, {Kind::TXS, &CPU6502::X, &CPU6502::SP}};
+            for (const auto &m : moves)
+            {
+                if (m.kind != kind)
+                    continue;
+                a.movzxb(RAX, reg(cpu.*m.from));
+                a.movb(reg(cpu.*m.to), RAX);
+                if (kind != Kind::TXS)
+                    setNZ(RAX);
+            }
+            break;
+        }
+
+        case Kind::CLC:
+        case Kind::SEC:
+            a.movbi(reg(p.c), kind == Kind::SEC);
+            break;
+        case Kind::CLI:
+        case Kind::SEI:
+            a.movbi(reg(p.i), kind == Kind::SEI);
+            break;
+        case Kind::CLD:
+        case Kind::SED:
+            a.movbi(reg(p.d), kind == Kind::SED);
+            break;
+        case Kind::CLV:
+            a.movbi(reg(p.vres), 0);
+            break;
+
+        case Kind::NOP:
+            if (penalty)
+                operandAddress(op, true); // NOP abs,X still takes the page-cross cycle
+            break;
+
+        case Kind::PHA:
+            a.movzxb(RAX, A);
+            push(RAX);
+            break;
+        case Kind::PLA:
+            pop(RAX);
+            a.movb(A, RAX);
+            setNZ(RAX);
+            break;
+        case Kind::PHP:
+            packStatus();
+            a.alui(OR, RAX, 0x30);
+            push(RAX);
+            break;
+        case Kind::PLP:
+            pop(RAX);
+            a.alui(AND, RAX, 0xEF);
+            a.alui(OR, RAX, 0x20);
+            unpackStatus(RAX);
+            break;
+
+        case Kind::BCC:
+        case Kind::BCS:
+        case Kind::BEQ:
+        case Kind::BNE:
+        case Kind::BMI:
+        case Kind::BPL:
+        case Kind::BVC:
+        case Kind::BVS:
+        {
+            // Z is zres == 0, C is c != 0, N and V are bit 7 of nres/vres
+            Cond taken;
+            switch (kind)
+            {
+            case Kind::BCC:
+            case Kind::BCS:
+                a.cmpbi(reg(p.c), 0);
+                taken = kind == Kind::BCS ? CC_NE : CC_E;
+                break;
+            case Kind::BEQ:
+            case Kind::BNE:
+                a.cmpbi(reg(p.zres), 0);
+                taken = kind == Kind::BEQ ? CC_E : CC_NE;
+                break;
+            case Kind::BMI:
+            case Kind::BPL:
+                a.testbi(reg(p.nres), 0x80);
+                taken = kind == Kind::BMI ? CC_NE : CC_E;
+                break;
+            default:
+                a.testbi(reg(p.vres), 0x80);
+                taken = kind == Kind::BVS ? CC_NE : CC_E;
+                break;
+            }
+            uint16_t target = next + int8_t(op.lo);
+            int branch = a.newLabel();
+            a.jcc(taken, branch);
+            jumpTo(next, ins.cycle, false);
+            a.bind(branch);
+            jumpTo(target, ins.cycle + 1 + ((next ^ target) > 0xFF), chain);
+            return true;
+        }
+
+        case Kind::JMP:
+            if (mode == Mode::ABS)
+            {
+                jumpTo(operand, ins.cycle, chain);
+                return true;
+            }
+            else
+            {
+                // The pointer's high byte comes from the same page ($xxFF wraps)
+                uint16_t hiAddr = (operand & 0xFF) == 0xFF ? operand & 0xFF00 : operand + 1;
+                const uint8_t *page = bus.readPage[operand >> 8];
+                if (!isRAM(page, operand >> 8))
+                {
+                    jumpTo(page[operand & 0xFF] | (page[hiAddr & 0xFF] << 8), ins.cycle, chain);
+                    return true;
+                }
+                a.movzxb(RCX, ram(operand & 0x07FF));
+                a.movzxb(RAX, ram(hiAddr & 0x07FF));
+                a.shl(RAX, 8);
+                a.alu(OR, RCX, RAX);
+                jumpDynamic(ins.cycle);
+                return true;
+            }
+
+        case Kind::JSR:
+            a.movi(RAX, uint16_t(pc + 2) >> 8);
+            push(RAX);
+            a.movi(RAX, uint16_t(pc + 2) & 0xFF);
+            push(RAX);
+            jumpTo(operand, ins.cycle, chain);
+            return true;
+
+        case Kind::RTS:
+        case Kind::RTI:
+            if (kind == Kind::RTI)
+            {
+                pop(RAX);
+                a.alui(AND, RAX, 0xEF);
+                a.alui(OR, RAX, 0x20);
+                unpackStatus(RAX);
+            }
+            pop(RAX);
+            pop(RCX);
+            a.shl(RCX, 8);
+            a.alu(OR, RCX, RAX);
+            if (kind == Kind::RTS)
+                a.alui(ADD, RCX, 1);
+            jumpDynamic(ins.cycle);
+            return true;
+
+        case Kind::None:
+            break;
+        }
+
+        charge(ins.cycle, penalty);
+        a.jcc(CC_LE, exitAt(k + 1));
+        if (kind == Kind::CLI || kind == Kind::PLP)
+            checkIRQ(k + 1);
+        return false;
+    }
+
+    int BlockCompiler::compile(bool &idleSafe)
+    {
+        for (int &label : exits)
+            label = -1;
+        exitDone = a.newLabel();
+        epilogue = a.newLabel();
+        body = a.newLabel();
+
+        a.push(RBX);
+        a.push(R12);
+        a.push(R13);
+        a.movq(RBX, ARG0);
+        a.mov(R13, ARG1);
+        a.movqi(R12, reinterpret_cast<uintptr_t>(&bus));
+        a.bind(body);
+
+        idleSafe = true;
+        bool left = false;
+        uint16_t pc = block.pc;
+        for (int k = 0; k < block.length && !left; k++)
+        {
+            const CPU6502::DecodedOp &op = block.ops[k];
+            pcs[k] = pc;
+            if (!translatable(op, pc))
+                break;
+            idleSafe = idleSafe && CPU6502::idleSafeOp(op.opcode);
+            count = k + 1;
+            left = emit(k, op, pc, !idleSafe);
+            pc += op.length;
+        }
+        pcs[count] = pc;
+        if (count == 0)
+            return 0;
+        if (!left)
+            a.jmp(exitAt(count));
+
+        for (int k = 0; k <= count; k++)
+        {
+            if (exits[k] < 0)
+                continue;
+            a.bind(exits[k]);
+            a.movwi(cpuField(&cpu.PC), pcs[k]);
+            a.movbi(cpuField(&cpu.nativeOps), k);
+            a.jmp(epilogue);
+        }
+        a.bind(exitDone);
+        a.movbi(cpuField(&cpu.nativeOps), count);
+        a.bind(epilogue);
+        a.mov(RAX, R13);
+        a.pop(R13);
+        a.pop(R12);
+        a.pop(RBX);
+        a.ret();
+        a.patch();
+        return count;
+    }
+}
+
+void CPU6502::compileBlock(const CodeBlock &block)
+{
+    if (!CodeArena::available())
+        return;
+    if (compiled.empty())
+        compiled.resize(BLOCK_SLOTS);
+
+    CompiledBlock &out = compiled[(block.pc ^ (block.pc >> 9)) & (BLOCK_SLOTS - 1)];
+    out = CompiledBlock();
+
+    BlockCompiler compiler(*this, block);
+    bool idleSafe;
+    int length = compiler.compile(idleSafe);
+    if (length == 0)
+        return;
+
+    const std::vector<uint8_t> &code = compiler.code();
+    CodeArena::Entry entry = nativeCode.add(code.data(), code.size());
+    if (!entry)
+    {
+        // Arena full: start again from this block
+        dropCompiled();
+        entry = nativeCode.add(code.data(), code.size());
+        if (!entry)
+            return;
+    }
+    out.pc = block.pc;
+    out.gen = block.gen;
+    out.length = uint8_t(length);
+    out.lastPC = compiler.lastPC();
+    out.idleSafe = idleSafe;
+    out.code = entry;
+}
+
+void CPU6502::dropCompiled()
+{
+    for (CompiledBlock &b : compiled)
+        b = CompiledBlock();
+    nativeCode.clear();
+}
+
+uint32_t CPU6502::runCompiled(uint32_t budget)
+{
+    // Native blocks make each access at once and skip the profiler hooks
+    if constexpr (Accuracy::cycleAccurate || Profiler::enabled)
+        return 0;
+
+    uint32_t spent = 0;
+    while (spent < budget && PC >= 0x8000 && !compiled.empty() && !irqDue())
+    {
+        const CompiledBlock &b = compiled[(PC ^ (PC >> 9)) & (BLOCK_SLOTS - 1)];
+        if (b.pc != PC || b.gen != romGen || !b.code)
+            break;
+
+        nativeOps = 0;
+        int32_t left = int32_t(budget - spent);
+        uint32_t used = uint32_t(left - b.code(this, left));
+        totalcycles += used;
+        spent += used;
+        curBlock = nullptr;
+
+        // Translated code reads no I/O, so for idle-loop tracking only the
+        // kind of instructions run and a backward transfer at the end count
+        if (detectIdleLoops && nativeOps)
+        {
+            if (!b.idleSafe)
+                idleClean = false;
+            else if (nativeOps == b.length && PC <= b.lastPC)
+            {
+                loopHead();
+                if (idleLoopCycles)
+                    break;
+            }
+        }
+        if (nativeOps < b.length)
+            break; // bailed out, or out of budget
+    }
+    return spent;
+}
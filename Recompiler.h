@@ -0,0 +1,47 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "BusPolicy.h"
+
+inline namespace SIMPLENES_BUS_NAMESPACE
+{
+class CPU6502;
+}
+
+// Executable memory for CPU6502's native block translator. Blocks are copied
+// in one at a time and never freed individually; when the arena is full the
+// CPU drops every translation and starts over. The pages are only writable
+// while add() copies into them, never writable and executable at once.
+//
+// Native code is emitted for x86-64 hosts (System V and Windows calling
+// conventions) that can map executable memory: mmap/mprotect on POSIX,
+// VirtualAlloc/VirtualProtect on Windows. Elsewhere available() is false
+// and CPU6502 keeps interpreting.
+class CodeArena
+{
+public:
+    // A translated block: runs from the block's first instruction until it
+    // leaves the block, bails out to the interpreter or has used the budget
+    // (CPU cycles), and returns what is left of it (negative when the last
+    // instruction ran past it).
+    using Entry = int32_t (*)(CPU6502 *cpu, int32_t budget);
+
+    static constexpr size_t CAPACITY = size_t(1) << 20;
+    // Protection granularity: the x86-64 page size
+    static constexpr size_t PAGE = 4096;
+
+    static bool available();
+
+    CodeArena() = default;
+    ~CodeArena();
+    CodeArena(const CodeArena &) = delete;
+    CodeArena &operator=(const CodeArena &) = delete;
+
+    // Copies size bytes of code in; null when it doesn't fit
+    Entry add(const uint8_t *code, size_t size);
+    void clear() { used = 0; }
+
+private:
+    uint8_t *base = nullptr;
+    size_t used = 0;
+};
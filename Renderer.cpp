@@ -1,4 +1,5 @@
 #include "Renderer.h"
+#include "FrameConvert.h"
 #include <SDL2/SDL.h>
 #include <iostream>
 
@@ -61,16 +62,7 @@ void Renderer::drawFrame(PPU2C02& ppu) {
         return;
     }
 
-    uint32_t* dst = reinterpret_cast<uint32_t*>(pixels);
-
-    for (int y = 0; y < HEIGHT; y++) {
-        uint32_t* row = (uint32_t*)((uint8_t*)dst + y * pitch);
-
-        for (int x = 0; x < WIDTH; x++) {
-            auto c = ppu.framebuffer[y][x];
-            row[x] = 0xFF000000 | (c.r << 16) | (c.g << 8) | c.b;
-        }
-    }
+    convertFrameARGB(ppu, reinterpret_cast<uint32_t*>(pixels), pitch);
 
     SDL_UnlockTexture(texture);
     SDL_RenderCopy(renderer, texture, nullptr, nullptr);
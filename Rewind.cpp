@@ -0,0 +1,233 @@
+#include "Rewind.h"
+#include "Bus.h"
+#include <algorithm>
+#include <cstring>
+
+// Byte-oriented LZ77 tuned for XOR deltas. A control byte below 0x80 is
+// followed by that many plus one literal bytes; otherwise it is a match of
+// (c & 0x7F) + 3 bytes at a 16-bit distance back. Distance 1 covers the long
+// zero runs unchanged memory turns into.
+namespace
+{
+    constexpr size_t MIN_MATCH = 3;
+    constexpr size_t MAX_MATCH = 0x7F + MIN_MATCH;
+    constexpr size_t MAX_LITERALS = 0x80;
+    constexpr size_t MAX_DISTANCE = 0xFFFF;
+    constexpr int HASH_BITS = 12;
+
+    size_t worstCase(size_t n) { return n + n / MAX_LITERALS + 1; }
+
+    uint32_t hash3(const uint8_t *p)
+    {
+        uint32_t v = p[0] | (p[1] << 8) | (p[2] << 16);
+        return (v * 2654435761u) >> (32 - HASH_BITS);
+    }
+
+    size_t matchLength(const uint8_t *src, size_t n, size_t from, size_t at)
+    {
+        size_t limit = std::min(MAX_MATCH, n - at);
+        size_t len = 0;
+        // Word at a time; unchanged memory makes most matches run to the limit
+        while (len + 8 <= limit)
+        {
+            uint64_t a, b;
+            memcpy(&a, src + from + len, 8);
+            memcpy(&b, src + at + len, 8);
+            if (a != b)
+                break;
+            len += 8;
+        }
+        while (len < limit && src[from + len] == src[at + len])
+            len++;
+        return len;
+    }
+
+    size_t compress(const uint8_t *src, size_t n, uint8_t *dst, uint32_t *table)
+    {
+        std::fill(table, table + (1 << HASH_BITS), UINT32_MAX);
+        size_t out = 0;
+        size_t literals = 0; // start of the pending literal run
+        auto flushLiterals = [&](size_t end)
+        {
+            while (literals < end)
+            {
+                size_t run = std::min(end - literals, MAX_LITERALS);
+                dst[out++] = static_cast<uint8_t>(run - 1);
+                memcpy(dst + out, src + literals, run);
+                out += run;
+                literals += run;
+            }
+        };
+
+        size_t i = 0;
+        while (i + MIN_MATCH <= n)
+        {
+            size_t best = 0, distance = 0;
+            if (i > 0)
+            {
+                best = matchLength(src, n, i - 1, i);
+                distance = 1;
+            }
+            uint32_t h = hash3(src + i);
+            uint32_t candidate = table[h];
+            table[h] = static_cast<uint32_t>(i);
+            if (candidate != UINT32_MAX && i - candidate <= MAX_DISTANCE && i - candidate > 1)
+            {
+                size_t len = matchLength(src, n, candidate, i);
+                if (len > best)
+                {
+                    best = len;
+                    distance = i - candidate;
+                }
+            }
+
+            if (best < MIN_MATCH)
+            {
+                i++;
+                continue;
+            }
+            flushLiterals(i);
+            dst[out++] = static_cast<uint8_t>(0x80 | (best - MIN_MATCH));
+            dst[out++] = static_cast<uint8_t>(distance);
+            dst[out++] = static_cast<uint8_t>(distance >> 8);
+            i += best;
+            literals = i;
+        }
+        flushLiterals(n);
+        return out;
+    }
+
+    bool decompress(const uint8_t *src, size_t n, uint8_t *dst, size_t size)
+    {
+        size_t in = 0, out = 0;
+        while (in < n)
+        {
+            uint8_t c = src[in++];
+            if (c < 0x80)
+            {
+                size_t run = c + 1;
+                if (in + run > n || out + run > size)
+                    return false;
+                memcpy(dst + out, src + in, run);
+                in += run;
+                out += run;
+                continue;
+            }
+            size_t len = (c & 0x7F) + MIN_MATCH;
+            if (in + 2 > n)
+                return false;
+            size_t distance = src[in] | (src[in + 1] << 8);
+            in += 2;
+            if (distance == 0 || distance > out || out + len > size)
+                return false;
+            if (distance == 1)
+                memset(dst + out, dst[out - 1], len);
+            else if (distance >= len)
+                memcpy(dst + out, dst + out - distance, len);
+            else
+                for (size_t k = 0; k < len; k++) // overlaps itself
+                    dst[out + k] = dst[out + k - distance];
+            out += len;
+        }
+        return out == size;
+    }
+}
+
+RewindBuffer::RewindBuffer(size_t arenaBytes, unsigned interval)
+    : arena(arenaBytes), entries(arenaBytes / 128 + 1), hashTable(1 << HASH_BITS),
+      interval(std::max(1u, interval))
+{
+}
+
+void RewindBuffer::clear()
+{
+    first = 0;
+    count = 0;
+    writePos = 0;
+    used = 0;
+    frame = 0;
+    newest.clear();
+}
+
+void RewindBuffer::evictOldest()
+{
+    used -= entries[first].size;
+    first = (first + 1) % entries.size();
+    count--;
+}
+
+void RewindBuffer::capture(const Bus &bus)
+{
+    if (++frame < interval)
+        return;
+    frame = 0;
+
+    bus.saveState(current);
+    if (current.size() != newest.size())
+    {
+        // First capture, or a differently shaped machine: start a new chain
+        clear();
+        newest.swap(current);
+        packed.resize(worstCase(newest.size()));
+        return;
+    }
+
+    // current becomes the delta back to the previous capture, newest the new state
+    for (size_t i = 0; i < current.size(); i++)
+    {
+        uint8_t state = current[i];
+        current[i] ^= newest[i];
+        newest[i] = state;
+    }
+    size_t n = compress(current.data(), current.size(), packed.data(), hashTable.data());
+    if (n > arena.size())
+    {
+        // Doesn't fit at all; history before this point is unreachable
+        std::vector<uint8_t> keep;
+        keep.swap(newest);
+        clear();
+        newest.swap(keep);
+        return;
+    }
+
+    // Deltas sit in the arena in age order; reuse space from the oldest
+    size_t start = writePos;
+    if (start + n > arena.size())
+    {
+        while (count && entries[first].offset >= writePos)
+            evictOldest();
+        start = 0;
+    }
+    while (count && entries[first].offset >= start && entries[first].offset < start + n)
+        evictOldest();
+    if (count == entries.size())
+        evictOldest();
+
+    memcpy(arena.data() + start, packed.data(), n);
+    entries[(first + count) % entries.size()] = {start, static_cast<uint32_t>(n)};
+    count++;
+    used += n;
+    writePos = start + n;
+}
+
+bool RewindBuffer::stepBack(Bus &bus)
+{
+    if (!count)
+        return false;
+
+    const Entry &e = entries[(first + count - 1) % entries.size()];
+    current.resize(newest.size());
+    if (!decompress(arena.data() + e.offset, e.size, current.data(), current.size()))
+    {
+        clear();
+        return false;
+    }
+    for (size_t i = 0; i < newest.size(); i++)
+        newest[i] ^= current[i];
+
+    writePos = e.offset;
+    used -= e.size;
+    count--;
+    frame = 0;
+    return bus.loadState(newest);
+}
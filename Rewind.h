@@ -0,0 +1,51 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class Bus;
+
+// Rewind history. Every interval-th capture the machine is saved, XORed with
+// the previous capture and the delta (mostly zeros) is LZ-compressed into a
+// fixed arena. Deltas chain backwards from the newest full state, so the
+// oldest ones are simply dropped when the arena fills. All buffers are sized
+// on the first capture; after that capturing and rewinding never allocate.
+class RewindBuffer
+{
+public:
+    explicit RewindBuffer(size_t arenaBytes = size_t(64) << 20, unsigned interval = 1);
+
+    // Call once per emulated frame
+    void capture(const Bus &bus);
+    // Restores the machine to the previous capture; false when history is empty
+    bool stepBack(Bus &bus);
+    // Forget everything, e.g. after loading a save state
+    void clear();
+
+    size_t snapshots() const { return count; }
+    size_t bytesUsed() const { return used; }
+    size_t capacity() const { return arena.size(); }
+
+private:
+    struct Entry
+    {
+        size_t offset;
+        uint32_t size; // compressed bytes
+    };
+
+    void evictOldest();
+
+    std::vector<uint8_t> arena;
+    std::vector<Entry> entries; // ring, oldest at first
+    size_t first = 0;
+    size_t count = 0;
+    size_t writePos = 0; // arena offset for the next delta
+    size_t used = 0;
+
+    std::vector<uint8_t> newest; // full state of the latest capture
+    std::vector<uint8_t> current;
+    std::vector<uint8_t> packed; // compressor output, worst case sized
+    std::vector<uint32_t> hashTable;
+    unsigned interval;
+    unsigned frame = 0;
+};
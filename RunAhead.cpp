@@ -0,0 +1,47 @@
+#include "RunAhead.h"
+
+bool RunAhead::enableSecondInstance(const std::shared_ptr<const RomImage> &rom)
+{
+    auto cart = std::make_shared<Cartridge>(rom);
+    if (!cart->isImageValid())
+        return false;
+
+    aheadCart = cart;
+    ahead = std::make_unique<Bus>();
+    ahead->insertCartridge(aheadCart);
+    ahead->cpu.connectBus(ahead.get());
+    ahead->ppu.connectCartridge(aheadCart);
+    return true;
+}
+
+void RunAhead::disableSecondInstance()
+{
+    ahead.reset();
+    aheadCart.reset();
+}
+
+PPU2C02 &RunAhead::runFrame(Bus &bus)
+{
+    bus.runFrame();
+    bus.ppu.frame_complete = false;
+    if (!frames)
+        return bus.ppu;
+
+    bus.saveState(state);
+    Bus &future = ahead ? *ahead : bus;
+    if (ahead)
+    {
+        ahead->cpu.useRecompiler = bus.cpu.useRecompiler;
+        if (!ahead->loadState(state))
+            return bus.ppu;
+    }
+    for (unsigned i = 0; i < frames; i++)
+    {
+        future.runFrame();
+        future.ppu.frame_complete = false;
+    }
+    // The framebuffer isn't part of a state, so the future picture survives this
+    if (!ahead)
+        bus.loadState(state);
+    return future.ppu;
+}
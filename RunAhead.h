@@ -0,0 +1,33 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include "Bus.h"
+
+// Run-ahead. Most games read the pad during one frame and only show the result
+// a frame or two later. Each host frame this runs the real frame, saves the
+// machine, emulates frames more with the same input and shows the last one,
+// then rolls back, hiding that many frames of the game's own lag.
+//
+// With a second instance the frames ahead run on a private machine that is
+// loaded from the real one instead, so the real machine is never rolled back.
+// It costs a second Bus and cartridge (sharing the ROM image) but saves the
+// restore.
+class RunAhead
+{
+public:
+    unsigned frames = 0; // frames to run ahead, 0 = off
+
+    // Builds the private machine around the same ROM image; false if unusable
+    bool enableSecondInstance(const std::shared_ptr<const RomImage> &rom);
+    void disableSecondInstance();
+    bool secondInstance() const { return ahead != nullptr; }
+
+    // Emulates one real frame on bus plus the frames ahead. Returns the PPU
+    // whose framebuffer should be presented.
+    PPU2C02 &runFrame(Bus &bus);
+
+private:
+    std::unique_ptr<Bus> ahead;
+    std::shared_ptr<Cartridge> aheadCart;
+    std::vector<uint8_t> state;
+};
@@ -0,0 +1,186 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Binary SingleStepTests corpus, written by tools/sst2bin and read in place
+// by CPUsst --bin. Layout (little endian):
+//
+//   Header
+//   Case[caseCount]   grouped by opcode, opcodeStart[] indexes them
+//   Cell[cellCount]   RAM cells; each case owns a contiguous run
+//
+// Every field is fixed size, so the runner never parses or allocates.
+namespace sst
+{
+    const char MAGIC[8] = {'S', 'S', 'T', 'B', 'I', 'N', 0, 0};
+    const uint32_t VERSION = 1;
+
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t caseCount;
+        uint32_t cellCount;
+        uint32_t opcodeStart[257]; // cases of opcode n are [opcodeStart[n], opcodeStart[n + 1])
+    };
+
+    struct Regs
+    {
+        uint16_t pc;
+        uint8_t a, x, y, s, p;
+        uint8_t pad;
+    };
+
+    struct Case
+    {
+        Regs initial;
+        Regs final;
+        uint32_t firstCell;   // initial cells, then final cells
+        uint8_t initialCells;
+        uint8_t finalCells;
+        uint8_t cycles;       // bus cycles the instruction takes
+        uint8_t pad;
+    };
+
+    struct Cell
+    {
+        uint16_t addr;
+        uint8_t value;
+        uint8_t pad;
+    };
+
+    static_assert(sizeof(Regs) == 8 && sizeof(Case) == 24 && sizeof(Cell) == 4, "corpus layout");
+
+    // Read-only view of a whole file: mmap, or a file mapping on Windows
+    class MappedFile
+    {
+    public:
+        ~MappedFile() { close(); }
+
+        bool open(const std::string &path)
+        {
+            close();
+#ifdef _WIN32
+            file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, 0, nullptr);
+            if (file == INVALID_HANDLE_VALUE)
+                return false;
+            LARGE_INTEGER fileSize;
+            GetFileSizeEx(file, &fileSize);
+            size = static_cast<size_t>(fileSize.QuadPart);
+            mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (mapping)
+                data = static_cast<const uint8_t *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0)
+                return false;
+            struct stat st;
+            if (fstat(fd, &st) == 0 && st.st_size > 0)
+            {
+                size = static_cast<size_t>(st.st_size);
+                void *p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+                data = p == MAP_FAILED ? nullptr : static_cast<const uint8_t *>(p);
+            }
+            ::close(fd);
+#endif
+            if (!data)
+                close();
+            return data != nullptr;
+        }
+
+        void close()
+        {
+#ifdef _WIN32
+            if (data)
+                UnmapViewOfFile(data);
+            if (mapping)
+                CloseHandle(mapping);
+            if (file != INVALID_HANDLE_VALUE)
+                CloseHandle(file);
+            mapping = nullptr;
+            file = INVALID_HANDLE_VALUE;
+#else
+            if (data)
+                munmap(const_cast<uint8_t *>(data), size);
+#endif
+            data = nullptr;
+            size = 0;
+        }
+
+        const uint8_t *data = nullptr;
+        size_t size = 0;
+
+    private:
+#ifdef _WIN32
+        HANDLE file = INVALID_HANDLE_VALUE;
+        HANDLE mapping = nullptr;
+#endif
+    };
+
+    // Validated pointers into a mapped corpus. attach checks everything the
+    // runner indexes with (the opcode table and every case's run of cells),
+    // so a truncated or corrupt file is refused up front rather than read
+    // out of bounds; error says what was wrong.
+    struct Corpus
+    {
+        const Header *header = nullptr;
+        const Case *cases = nullptr;
+        const Cell *cells = nullptr;
+
+        bool attach(const MappedFile &file, std::string &error)
+        {
+            header = nullptr;
+            cases = nullptr;
+            cells = nullptr;
+            if (file.size < sizeof(Header))
+                return fail(error, "too short for a header");
+            const Header *h = reinterpret_cast<const Header *>(file.data);
+            if (memcmp(h->magic, MAGIC, sizeof(MAGIC)) != 0)
+                return fail(error, "not a test corpus");
+            if (h->version != VERSION)
+                return fail(error, "corpus version " + std::to_string(h->version) + ", expected " +
+                                       std::to_string(VERSION));
+            uint64_t need = sizeof(Header) + uint64_t(h->caseCount) * sizeof(Case) +
+                            uint64_t(h->cellCount) * sizeof(Cell);
+            if (file.size < need)
+                return fail(error, "truncated: " + std::to_string(file.size) + " bytes, header needs " +
+                                       std::to_string(need));
+            if (h->opcodeStart[0] != 0 || h->opcodeStart[256] != h->caseCount)
+                return fail(error, "opcode table does not cover the cases");
+            for (int op = 0; op < 256; op++)
+            {
+                if (h->opcodeStart[op] > h->opcodeStart[op + 1])
+                    return fail(error, "opcode table goes backwards at opcode " + std::to_string(op));
+            }
+            const Case *c = reinterpret_cast<const Case *>(file.data + sizeof(Header));
+            for (uint32_t i = 0; i < h->caseCount; i++)
+            {
+                uint64_t end = uint64_t(c[i].firstCell) + c[i].initialCells + c[i].finalCells;
+                if (end > h->cellCount)
+                    return fail(error, "case " + std::to_string(i) + " runs past the cell table");
+            }
+            header = h;
+            cases = c;
+            cells = reinterpret_cast<const Cell *>(c + h->caseCount);
+            return true;
+        }
+
+    private:
+        static bool fail(std::string &error, const std::string &why)
+        {
+            error = why;
+            return false;
+        }
+    };
+}
@@ -0,0 +1,81 @@
+#include "SaveState.h"
+#include <algorithm>
+
+namespace
+{
+    const char MAGIC[8] = {'N', 'E', 'S', 'S', 'T', 'A', 'T', 'E'};
+    constexpr size_t HEADER_SIZE = sizeof(MAGIC) + sizeof(uint32_t);
+    constexpr size_t CHUNK_HEADER = 4 + sizeof(uint32_t);
+    constexpr size_t MIN_CAPACITY = 16 * 1024; // a whole state for most carts
+}
+
+StateWriter::StateWriter(std::vector<uint8_t> &out) : out(out)
+{
+    // Only bytes past the old size get initialized, so a buffer reused for
+    // every snapshot costs nothing here after the first
+    out.resize(std::max(out.capacity(), MIN_CAPACITY));
+    cur = out.data();
+    limit = cur + out.size();
+    bytes(MAGIC, sizeof(MAGIC));
+    put(STATE_VERSION);
+}
+
+StateWriter::~StateWriter()
+{
+    out.resize(cur - out.data());
+}
+
+void StateWriter::grow(size_t size)
+{
+    size_t used = cur - out.data();
+    out.resize(std::max(out.size() * 2, used + size));
+    cur = out.data() + used;
+    limit = out.data() + out.size();
+}
+
+void StateWriter::beginChunk(const char (&tag)[5])
+{
+    chunkStart = cur - out.data();
+    bytes(tag, 4);
+    put(uint32_t(0)); // patched by endChunk()
+}
+
+void StateWriter::endChunk()
+{
+    uint32_t size = static_cast<uint32_t>(cur - out.data() - chunkStart - CHUNK_HEADER);
+    memcpy(out.data() + chunkStart + 4, &size, sizeof(size));
+}
+
+StateReader::StateReader(const uint8_t *data, size_t size) : data(data), size(size)
+{
+    uint32_t version = 0;
+    if (size >= HEADER_SIZE && memcmp(data, MAGIC, sizeof(MAGIC)) == 0)
+    {
+        memcpy(&version, data + sizeof(MAGIC), sizeof(version));
+    }
+    headerOk = version == STATE_VERSION;
+}
+
+bool StateReader::open(const char (&tag)[5])
+{
+    if (!headerOk)
+        return false;
+
+    size_t at = HEADER_SIZE;
+    while (at + CHUNK_HEADER <= size)
+    {
+        uint32_t length;
+        memcpy(&length, data + at + 4, sizeof(length));
+        size_t payload = at + CHUNK_HEADER;
+        if (payload + length > size)
+            return false;
+        if (memcmp(data + at, tag, 4) == 0)
+        {
+            pos = payload;
+            end = payload + length;
+            return true;
+        }
+        at = payload + length;
+    }
+    return false;
+}
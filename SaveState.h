@@ -0,0 +1,130 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+// Save state container. A state is a header ("NESSTATE", version) followed by
+// chunks, each a four-character tag and a payload size:
+//
+//   CPU   registers, cycle counters
+//   BUS   internal RAM, controllers, OAM DMA, interrupt lines, scheduler clocks
+//   PPU   VRAM, palette, OAM, registers and the in-flight render state
+//   CART  mirroring, CHR RAM and four-screen nametable RAM
+//   MAPR  mapper registers (may be empty)
+//
+// Values are stored in native byte order, so a state is only portable between
+// builds for the same platform. Only scalars and arrays without padding go in
+// whole (put/get refuse anything else); structs are written field by field.
+// Readers skip chunks they don't know; bump STATE_VERSION whenever an
+// existing chunk's layout changes.
+constexpr uint32_t STATE_VERSION = 4;
+
+// Writes straight into out's storage through a cursor, growing it only when
+// a write doesn't fit; out is cut to the bytes written when the writer goes.
+class StateWriter
+{
+public:
+    // Starts a new state in out, reusing its capacity
+    explicit StateWriter(std::vector<uint8_t> &out);
+    ~StateWriter();
+    StateWriter(const StateWriter &) = delete;
+    StateWriter &operator=(const StateWriter &) = delete;
+
+    void beginChunk(const char (&tag)[5]);
+    void endChunk();
+
+    void bytes(const void *data, size_t size)
+    {
+        if (size > size_t(limit - cur))
+            grow(size);
+        memcpy(cur, data, size);
+        cur += size;
+    }
+
+    template <typename T>
+    void put(const T &value)
+    {
+        static_assert(std::has_unique_object_representations<T>::value, "no padding: write fields instead");
+        bytes(&value, sizeof(T));
+    }
+
+private:
+    void grow(size_t size);
+
+    std::vector<uint8_t> &out;
+    uint8_t *cur = nullptr;
+    uint8_t *limit = nullptr;
+    size_t chunkStart = 0;
+};
+
+class StateReader
+{
+public:
+    StateReader(const uint8_t *data, size_t size);
+
+    // Header is present and the version matches
+    bool valid() const { return headerOk; }
+    // Positions the reader at the payload of the chunk; false if absent
+    bool open(const char (&tag)[5]);
+    // Payload bytes of the open chunk not read yet
+    size_t remaining() const { return end - pos; }
+    // False once a read ran past the end of its chunk
+    bool ok() const { return !overrun; }
+
+    // For checking a chunk before it is applied: skip() passes over fields
+    // that may hold anything, within() reads one and says whether it lies in
+    // [lo, hi], flag() whether a bool field holds 0 or 1.
+    void skip(size_t size)
+    {
+        if (pos + size > end)
+        {
+            overrun = true;
+            pos = end;
+            return;
+        }
+        pos += size;
+    }
+
+    template <typename T>
+    bool within(T lo, T hi)
+    {
+        T value;
+        get(value);
+        return value >= lo && value <= hi;
+    }
+
+    bool flag()
+    {
+        static_assert(sizeof(bool) == 1, "bools are stored as one byte");
+        return within<uint8_t>(0, 1);
+    }
+
+    void bytes(void *dest, size_t size)
+    {
+        if (pos + size > end)
+        {
+            overrun = true;
+            memset(dest, 0, size);
+            return;
+        }
+        memcpy(dest, data + pos, size);
+        pos += size;
+    }
+
+    template <typename T>
+    void get(T &value)
+    {
+        static_assert(std::has_unique_object_representations<T>::value, "no padding: read fields instead");
+        bytes(&value, sizeof(T));
+    }
+
+private:
+    const uint8_t *data;
+    size_t size;
+    size_t pos = 0;
+    size_t end = 0;
+    bool headerOk = false;
+    bool overrun = false;
+};
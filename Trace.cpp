@@ -0,0 +1,104 @@
+#include "Trace.h"
+#include "CPU6502.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+namespace
+{
+    const char traceMagic[8] = {'N', 'E', 'S', 'T', 'R', 'A', 'C', 'E'};
+    const uint32_t traceVersion = 1;
+}
+
+TraceBuffer::TraceBuffer(size_t capacity)
+{
+    size_t size = 1;
+    while (size < capacity)
+        size <<= 1;
+    records.resize(size);
+    mask = size - 1;
+}
+
+void TraceBuffer::writeHeader(std::ostream &os)
+{
+    uint32_t recordSize = sizeof(TraceRecord);
+    os.write(traceMagic, sizeof(traceMagic));
+    os.write(reinterpret_cast<const char *>(&traceVersion), sizeof(traceVersion));
+    os.write(reinterpret_cast<const char *>(&recordSize), sizeof(recordSize));
+}
+
+bool TraceBuffer::streamTo(const std::string &path)
+{
+    closeStream();
+    stream.open(path, std::ios::binary | std::ios::trunc);
+    if (!stream)
+        return false;
+    writeHeader(stream);
+    return true;
+}
+
+void TraceBuffer::closeStream()
+{
+    if (stream.is_open())
+        stream.close();
+}
+
+std::vector<TraceRecord> TraceBuffer::last(size_t n) const
+{
+    uint64_t end = head.load(std::memory_order_acquire);
+    uint64_t count = std::min<uint64_t>({n, end, records.size()});
+    std::vector<TraceRecord> out(count);
+    for (uint64_t i = 0; i < count; i++)
+        out[i] = records[(end - count + i) & mask];
+
+    // The writer may have lapped the oldest entries while we copied them
+    uint64_t now = head.load(std::memory_order_acquire);
+    uint64_t overwritten = now - end;
+    if (overwritten >= count)
+        return {};
+    out.erase(out.begin(), out.begin() + overwritten);
+    return out;
+}
+
+bool TraceBuffer::dump(const std::string &path, size_t n) const
+{
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out)
+        return false;
+    writeHeader(out);
+    std::vector<TraceRecord> tail = last(n);
+    out.write(reinterpret_cast<const char *>(tail.data()), tail.size() * sizeof(TraceRecord));
+    return bool(out);
+}
+
+bool TraceBuffer::readFile(const std::string &path, std::vector<TraceRecord> &out)
+{
+    std::ifstream in(path, std::ios::binary);
+    char magic[8];
+    uint32_t version = 0, recordSize = 0;
+    in.read(magic, sizeof(magic));
+    in.read(reinterpret_cast<char *>(&version), sizeof(version));
+    in.read(reinterpret_cast<char *>(&recordSize), sizeof(recordSize));
+    if (!in || memcmp(magic, traceMagic, sizeof(magic)) != 0 || version != traceVersion ||
+        recordSize != sizeof(TraceRecord))
+    {
+        return false;
+    }
+
+    TraceRecord r;
+    out.clear();
+    while (in.read(reinterpret_cast<char *>(&r), sizeof(r)))
+        out.push_back(r);
+    return true;
+}
+
+std::string TraceBuffer::format(const TraceRecord &r, bool withPPU)
+{
+    char line[96];
+    int n = snprintf(line, sizeof(line), "%04X  %02X %s          A:%02X X:%02X Y:%02X P:%02X SP:%02X",
+                     r.pc, r.opcode, CPU6502::lookup[r.opcode].opcodename, r.a, r.x, r.y, r.p, r.sp);
+    if (withPPU)
+        n += snprintf(line + n, sizeof(line) - n, " PPU:%3d,%3d", r.scanline, r.dot);
+    snprintf(line + n, sizeof(line) - n, " CYC:%llu", static_cast<unsigned long long>(r.cycle));
+    return line;
+}
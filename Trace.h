@@ -0,0 +1,70 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// One executed instruction, captured before it runs. Fixed size so records
+// can be written straight to a file and read back by tools/nestrace.
+struct TraceRecord
+{
+    uint64_t cycle;   // CPU cycle count (CYC in the log)
+    uint16_t pc;
+    uint16_t dot;     // PPU position
+    int16_t scanline;
+    uint8_t opcode;
+    uint8_t lo;       // operand bytes as fetched (unused ones are 0)
+    uint8_t hi;
+    uint8_t a;
+    uint8_t x;
+    uint8_t y;
+    uint8_t p;
+    uint8_t sp;
+    uint8_t pad[2];
+};
+static_assert(sizeof(TraceRecord) == 24, "TraceRecord is a file format");
+
+// Ring of the most recent records. The emulation thread is the only writer;
+// head is published with release order so another thread can copy out the
+// tail (last()/dump()) without stopping it. Records can also be streamed to
+// a file as they are produced.
+class TraceBuffer
+{
+public:
+    explicit TraceBuffer(size_t capacity = size_t(1) << 20); // rounded up to a power of two
+
+    void push(const TraceRecord &r)
+    {
+        uint64_t h = head.load(std::memory_order_relaxed);
+        records[h & mask] = r;
+        head.store(h + 1, std::memory_order_release);
+        if (stream.is_open())
+            stream.write(reinterpret_cast<const char *>(&r), sizeof(r));
+    }
+
+    bool streamTo(const std::string &path); // starts a new file with a header
+    void closeStream();
+
+    uint64_t total() const { return head.load(std::memory_order_acquire); }
+    size_t capacity() const { return records.size(); }
+
+    // Up to n of the newest records, oldest first
+    std::vector<TraceRecord> last(size_t n) const;
+    bool dump(const std::string &path, size_t n = SIZE_MAX) const;
+
+    // Trace file: "NESTRACE", version, record size, then the records
+    static bool readFile(const std::string &path, std::vector<TraceRecord> &out);
+    // One line in the same format as CPU6502::debugStr(), optionally with
+    // the PPU position before CYC
+    static std::string format(const TraceRecord &r, bool withPPU = false);
+
+private:
+    static void writeHeader(std::ostream &os);
+
+    std::vector<TraceRecord> records;
+    uint64_t mask;
+    std::atomic<uint64_t> head{0};
+    std::ofstream stream;
+};
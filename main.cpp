@@ -1,8 +1,22 @@
+#ifdef _WIN32
 #include <windows.h>
+#else
+#include <iostream>
+#endif
 #include <vector>
 #include <string>
 #include "Emulator.h"
 
+static void showMessage(const char *title, const char *text)
+{
+#ifdef _WIN32
+    MessageBoxA(NULL, text, title, MB_OK);
+#else
+    std::cerr << title << ": " << text << std::endl;
+#endif
+}
+
+#ifdef _WIN32
 int WinMain(HINSTANCE hInst, HINSTANCE hPrev, LPSTR lpCmdLine, int nShowCmd)
 {
     // convert lpCmdLine into normal argc/argv
@@ -17,14 +31,30 @@ int WinMain(HINSTANCE hInst, HINSTANCE hPrev, LPSTR lpCmdLine, int nShowCmd)
     }
 
     LocalFree(wideArgv);
+#else
+int main(int argc, char **argv_)
+{
+    std::vector<std::string> argv(argv_, argv_ + argc);
+#endif
 
     if (argc < 2) {
-        MessageBoxA(NULL, "Usage: SimpleNES <rom.nes>", "Error", MB_OK);
+        showMessage("Error", "Usage: SimpleNES <rom.nes> [--runahead N] [--second-instance]");
         return 0;
     }
 
+    unsigned runAhead = 0;
+    bool secondInstance = false;
+    for (int i = 2; i < argc; i++) {
+        if (argv[i] == "--runahead" && i + 1 < argc)
+            runAhead = std::stoul(argv[++i]);
+        else if (argv[i] == "--second-instance")
+            secondInstance = true;
+    }
+
     Emulator emu;
     emu.loadROM(argv[1]);
+    if (!emu.setRunAhead(runAhead, secondInstance))
+        showMessage("Warning", "Run-ahead: could not load a second instance");
     emu.run();
     return 0;
 }
@@ -1,6 +1,9 @@
 #pragma once
 #include <cstdint>
 
+class StateWriter;
+class StateReader;
+
 class Mapper
 {
 public:
@@ -13,7 +16,67 @@ public:
     virtual bool ppuMapRead(uint16_t addr, uint32_t &mapped_addr) = 0;
     virtual bool ppuMapWrite(uint16_t addr, uint32_t &mapped_addr) = 0;
 
+    // Bumped whenever the CPU-side bank layout changes; the Bus rebuilds its
+    // page table when this moves
+    uint32_t cpuMapVersion() const { return cpuMapChanges; }
+    // Likewise for CHR banks; the Cartridge re-points its pattern table slots
+    uint32_t ppuMapVersion() const { return ppuMapChanges; }
+
+    // Nametables. The PPU keeps a pointer to each 1 KB page of $2000-$2FFF and
+    // has the cartridge fill them in on insert, after a state load and
+    // whenever ntMapVersion() moves. A mapper that controls mirroring, or
+    // brings nametable RAM of its own, points pages at ciram (the console's
+    // 2 KB) or its own memory and returns true; otherwise the cartridge wires
+    // them from the iNES header.
+    virtual bool mapNametables(uint8_t *ciram, uint8_t *pages[4])
+    {
+        (void)ciram;
+        (void)pages;
+        return false;
+    }
+    uint32_t ntMapVersion() const { return ntMapChanges; }
+
+    // Bank registers and counters for save states; stateless mappers keep
+    // the empty defaults. loadState must bump the map versions above for
+    // every layout it changes, since the Bus and Cartridge only rewire on a
+    // version change. checkState reads the chunk without applying it and
+    // returns false if a bank number, mode or other index is out of range;
+    // the Bus calls it before loading anything.
+    virtual void saveState(StateWriter &) const {}
+    virtual void loadState(StateReader &) {}
+    virtual bool checkState(StateReader &) const { return true; }
+
+    // The Bus hands over its interrupt word and this mapper's bit on insert
+    void connectIRQ(uint8_t *lines, uint8_t bit)
+    {
+        irqLines = lines;
+        irqBit = bit;
+    }
+
+    // IRQ timing for the catch-up scheduler. The Bus only syncs the PPU (and
+    // so the mapper) at events it can predict, so a mapper with an IRQ
+    // counter reports how many PPU dots after the last sync its line can
+    // next go up, counting the dot that raises it, or NO_IRQ while nothing
+    // is armed. The Bus asks after every sync and after every write the
+    // mapper takes; without this the IRQ would only be seen at the next
+    // vblank or frame end.
+    static constexpr uint32_t NO_IRQ = UINT32_MAX;
+    virtual uint32_t dotsUntilIRQ() const { return NO_IRQ; }
+
 protected:
+    // Mappers with an IRQ counter hold the line with setIRQ(true) until the
+    // game acknowledges it
+    void setIRQ(bool asserted)
+    {
+        if (irqLines)
+            *irqLines = asserted ? (*irqLines | irqBit) : (*irqLines & ~irqBit);
+    }
+
+    uint32_t cpuMapChanges = 0;
+    uint32_t ppuMapChanges = 0;
+    uint32_t ntMapChanges = 0;
+    uint8_t *irqLines = nullptr;
+    uint8_t irqBit = 0;
     uint8_t nPRGBanks = 0;
     uint8_t nCHRBanks = 0;
 };
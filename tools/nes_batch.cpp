@@ -0,0 +1,194 @@
+// Runs many independent machines on a thread pool and reports where each ended.
+//
+//   nes_batch [-j threads] [--jit] [--ram] jobs.txt
+//
+// Each non-empty line of jobs.txt that doesn't start with '#' is one job:
+//
+//   rom.nes frames [movie.fm2]
+//
+// Every distinct ROM and movie is loaded once up front. All jobs on the same
+// ROM share one RomImage; a job owns only its Bus, Cartridge (mapper state,
+// CHR RAM) and decode caches. Results are printed in job order, one line
+// each: ROM, movie, frames, CPU cycles, frame hash and RAM hash, plus the
+// 2 KB of internal RAM in hex with --ram.
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Bus.h"
+#include "Playback.h"
+
+namespace
+{
+    struct Job
+    {
+        std::string romPath;
+        std::string moviePath;
+        uint64_t frames = 0;
+        std::shared_ptr<const RomImage> rom;
+        const std::vector<InputFrame> *movie = nullptr;
+    };
+
+    struct Result
+    {
+        PlaybackResult run{0, 0};
+        uint64_t frameHash = 0;
+        uint64_t ramHash = 0;
+        uint8_t ram[2048];
+    };
+
+    bool readJobs(const std::string &path, std::vector<Job> &jobs)
+    {
+        std::ifstream in(path);
+        if (!in)
+            return false;
+
+        std::string line;
+        int lineNo = 0;
+        while (std::getline(in, line))
+        {
+            lineNo++;
+            std::istringstream fields(line);
+            Job job;
+            if (!(fields >> job.romPath) || job.romPath[0] == '#')
+                continue;
+            if (!(fields >> job.frames))
+            {
+                std::cerr << "nes_batch: " << path << ":" << lineNo << ": expected \"rom.nes frames [movie]\"\n";
+                return false;
+            }
+            fields >> job.moviePath;
+            jobs.push_back(job);
+        }
+        return true;
+    }
+
+    void runJob(const Job &job, bool jit, Result &result)
+    {
+        static const std::vector<InputFrame> noInput;
+        auto cart = std::make_shared<Cartridge>(job.rom);
+        auto bus = std::make_unique<Bus>();
+        bus->insertCartridge(cart);
+        bus->cpu.connectBus(bus.get());
+        bus->cpu.reset();
+        bus->ppu.connectCartridge(cart);
+        bus->cpu.useRecompiler = jit;
+
+        result.run = play(*bus, job.movie ? *job.movie : noInput, job.frames, 0);
+        result.frameHash = frameHash(bus->ppu);
+        result.ramHash = ramHash(*bus);
+        memcpy(result.ram, bus->CPUmem, sizeof(result.ram));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    bool jit = false;
+    bool dumpRAM = false;
+    std::vector<std::string> files;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+            threads = std::max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--jit") == 0)
+            jit = true;
+        else if (strcmp(argv[i], "--ram") == 0)
+            dumpRAM = true;
+        else
+            files.push_back(argv[i]);
+    }
+    if (files.size() != 1)
+    {
+        std::cerr << "usage: nes_batch [-j threads] [--jit] [--ram] jobs.txt\n";
+        return 2;
+    }
+
+    std::vector<Job> jobs;
+    if (!readJobs(files[0], jobs))
+    {
+        if (jobs.empty())
+            std::cerr << "nes_batch: cannot read " << files[0] << "\n";
+        return 1;
+    }
+
+    // Load every ROM and movie once; the workers only read them
+    std::map<std::string, std::shared_ptr<const RomImage>> roms;
+    std::map<std::string, std::vector<InputFrame>> movies;
+    for (Job &job : jobs)
+    {
+        auto &rom = roms[job.romPath];
+        if (!rom)
+            rom = RomImage::load(job.romPath);
+        if (!rom->valid)
+        {
+            std::cerr << "nes_batch: cannot load " << job.romPath << "\n";
+            return 1;
+        }
+        job.rom = rom;
+
+        if (job.moviePath.empty())
+            continue;
+        auto found = movies.find(job.moviePath);
+        if (found == movies.end())
+        {
+            found = movies.emplace(job.moviePath, std::vector<InputFrame>()).first;
+            if (!loadMovie(job.moviePath, found->second))
+            {
+                std::cerr << "nes_batch: cannot read " << job.moviePath << "\n";
+                return 1;
+            }
+        }
+        job.movie = &found->second;
+    }
+
+    std::vector<Result> results(jobs.size());
+    std::atomic<size_t> nextJob{0};
+    auto worker = [&]()
+    {
+        for (size_t i; (i = nextJob++) < jobs.size();)
+            runJob(jobs[i], jit, results[i]);
+    };
+
+    auto t0 = std::chrono::steady_clock::now();
+    std::vector<std::thread> pool;
+    for (unsigned i = 0; i < std::min<size_t>(threads, jobs.size()); i++)
+        pool.emplace_back(worker);
+    for (auto &t : pool)
+        t.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    uint64_t totalFrames = 0;
+    for (size_t i = 0; i < jobs.size(); i++)
+    {
+        const Result &r = results[i];
+        totalFrames += r.run.frames;
+        printf("%s\t%s\t%llu\t%llu\t%016llx\t%016llx\n", jobs[i].romPath.c_str(),
+               jobs[i].moviePath.empty() ? "-" : jobs[i].moviePath.c_str(), (unsigned long long)r.run.frames,
+               (unsigned long long)r.run.cycles, (unsigned long long)r.frameHash, (unsigned long long)r.ramHash);
+        if (dumpRAM)
+        {
+            for (uint8_t b : r.ram)
+                printf("%02x", b);
+            printf("\n");
+        }
+    }
+
+    size_t romBytes = 0;
+    for (const auto &rom : roms)
+        romBytes += rom.second->prg.size() + rom.second->chr.size();
+    fprintf(stderr, "%zu jobs on %u threads in %.2f s (%.0f frames/s); %zu ROMs, %zu KB shared; %zu KB Bus per job\n",
+            jobs.size(), threads, seconds, seconds > 0 ? totalFrames / seconds : 0.0, roms.size(), romBytes / 1024,
+            sizeof(Bus) / 1024);
+    return 0;
+}
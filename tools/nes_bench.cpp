@@ -0,0 +1,268 @@
+// Fixed-workload benchmark over a set of ROMs, for comparing builds.
+//
+//   nes_bench [--samples N] [--warmup N] [--jit] [--json out.json] [rom.nes...]
+//
+// Without ROMs it runs nestest.nes from the source tree. Each ROM is run 120
+// frames from power-on, then every workload starts from that state:
+//
+//   cpu         CPU6502::step() alone, the PPU never catches up; with --jit
+//               translated blocks run through runCompiled() first (cycles/s)
+//   ppu-render  the PPU alone with background and sprites on, stepped as
+//               Bus::syncPPU does it: whole lines where possible (dots/s)
+//   ppu-dots    the same with every dot through PPU2C02::tick() (dots/s)
+//   ppu-idle    the PPU alone with rendering off (dots/s)
+//   system      Bus::runFrame(), the whole machine (frames/s)
+//   convert     convertFrameARGB(), what Renderer::drawFrame does (frames/s)
+//   convert-*   the same with each conversion kernel this CPU supports
+//
+// Warmup samples are thrown away; the rest are reported as median, p10, p90,
+// min and max, on stdout and optionally as JSON stamped with the git revision
+// of the source tree and whether the build was optimized.
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Bus.h"
+#include "FrameConvert.h"
+#include "json.hpp"
+
+#ifdef _WIN32
+#define popen _popen
+#define pclose _pclose
+#endif
+
+using json = nlohmann::json;
+
+namespace
+{
+    constexpr unsigned SETTLE_FRAMES = 120;
+    constexpr uint64_t CPU_CYCLES = 300000; // per sample
+    constexpr unsigned PPU_FRAMES = 2;
+    constexpr unsigned DOTS_PER_FRAME = 341 * 262;
+    constexpr unsigned SYSTEM_FRAMES = 10;
+    constexpr unsigned CONVERT_FRAMES = 20;
+
+    struct Workload
+    {
+        const char *name;
+        const char *unit;
+        // Runs one sample and returns how many units it did
+        std::function<double()> run;
+    };
+
+    struct Summary
+    {
+        double median, p10, p90, min, max;
+    };
+
+    Summary summarize(std::vector<double> rates)
+    {
+        std::sort(rates.begin(), rates.end());
+        auto at = [&](double q) { return rates[size_t(q * (rates.size() - 1) + 0.5)]; };
+        return {at(0.5), at(0.1), at(0.9), rates.front(), rates.back()};
+    }
+
+    std::string gitRevision()
+    {
+        std::string cmd = std::string("git -C \"") + SIMPLENES_SOURCE_DIR + "\" rev-parse HEAD";
+        FILE *pipe = popen(cmd.c_str(), "r");
+        if (!pipe)
+            return "unknown";
+        char buf[64] = {};
+        bool ok = fgets(buf, sizeof(buf), pipe) != nullptr;
+        int status = pclose(pipe);
+        std::string rev = buf;
+        rev.erase(rev.find_last_not_of("\r\n") + 1);
+        if (!ok || status != 0 || rev.empty())
+            return "unknown";
+
+        cmd = std::string("git -C \"") + SIMPLENES_SOURCE_DIR + "\" status --porcelain --untracked-files=no";
+        pipe = popen(cmd.c_str(), "r");
+        if (pipe)
+        {
+            if (fgets(buf, sizeof(buf), pipe))
+                rev += "-dirty";
+            pclose(pipe);
+        }
+        return rev;
+    }
+
+    bool benchROM(const std::string &path, unsigned samples, unsigned warmup, bool jit, json &results)
+    {
+        auto cart = std::make_shared<Cartridge>(path);
+        if (!cart->isImageValid())
+        {
+            std::cerr << "nes_bench: cannot load " << path << "\n";
+            return false;
+        }
+        auto bus = std::make_unique<Bus>();
+        bus->insertCartridge(cart);
+        bus->cpu.connectBus(bus.get());
+        bus->cpu.reset();
+        bus->ppu.connectCartridge(cart);
+        bus->cpu.useRecompiler = jit;
+        auto frame = [&]
+        {
+            bus->runFrame();
+            bus->ppu.frame_complete = false;
+        };
+        for (unsigned f = 0; f < SETTLE_FRAMES; f++)
+            frame();
+        std::vector<uint8_t> start;
+        bus->saveState(start);
+
+        std::vector<uint32_t> pixels(256 * 240);
+        auto tickPPU = [&](uint8_t mask, bool lines)
+        {
+            bus->ppu.ppumask.from_byte(mask);
+            bus->ppu.lineRenderer = lines;
+            for (unsigned d = 0; d < PPU_FRAMES * DOTS_PER_FRAME;)
+            {
+                if (PPU_FRAMES * DOTS_PER_FRAME - d >= 341 && bus->ppu.tickLine())
+                {
+                    d += 341;
+                    continue;
+                }
+                bus->ppu.tick();
+                d++;
+            }
+            bus->ppu.lineRenderer = true;
+            bus->interrupts.clear(Bus::Interrupts::NMI);
+            return double(PPU_FRAMES * DOTS_PER_FRAME);
+        };
+        std::vector<Workload> workloads = {
+            {"cpu", "cycles/s", [&]
+             {
+                 CPU6502 &cpu = bus->cpu;
+                 uint64_t end = cpu.totalcycles + CPU_CYCLES;
+                 while (cpu.totalcycles < end)
+                 {
+                     if (!jit || !cpu.runCompiled(uint32_t(end - cpu.totalcycles)))
+                         cpu.step();
+                 }
+                 return double(CPU_CYCLES);
+             }},
+            {"ppu-render", "dots/s", [&] { return tickPPU(0x1E, true); }},
+            {"ppu-dots", "dots/s", [&] { return tickPPU(0x1E, false); }},
+            {"ppu-idle", "dots/s", [&] { return tickPPU(0x00, true); }},
+            {"system", "frames/s", [&]
+             {
+                 for (unsigned f = 0; f < SYSTEM_FRAMES; f++)
+                     frame();
+                 return double(SYSTEM_FRAMES);
+             }},
+            {"convert", "frames/s", [&]
+             {
+                 for (unsigned f = 0; f < CONVERT_FRAMES; f++)
+                     convertFrameARGB(bus->ppu, pixels.data(), 256 * sizeof(uint32_t));
+                 return double(CONVERT_FRAMES);
+             }},
+        };
+        static const char *const kernelWorkloads[] = {"convert-scalar", "convert-sse2", "convert-avx2"};
+        for (ConvertKernel kernel : {ConvertKernel::Scalar, ConvertKernel::SSE2, ConvertKernel::AVX2})
+        {
+            if (!convertKernelSupported(kernel))
+                continue;
+            workloads.push_back({kernelWorkloads[int(kernel)], "frames/s", [&, kernel]
+                                 {
+                                     for (unsigned f = 0; f < CONVERT_FRAMES; f++)
+                                         convertFrameARGB(bus->ppu, pixels.data(), 256 * sizeof(uint32_t), kernel);
+                                     return double(CONVERT_FRAMES);
+                                 }});
+        }
+
+        for (const Workload &w : workloads)
+        {
+            bus->loadState(start);
+            std::vector<double> rates;
+            for (unsigned s = 0; s < warmup + samples; s++)
+            {
+                auto t0 = std::chrono::steady_clock::now();
+                double units = w.run();
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+                if (s >= warmup)
+                    rates.push_back(units / seconds);
+            }
+            Summary sum = summarize(rates);
+            printf("%-24s %-14s %14.0f %14.0f %14.0f  %s\n", path.substr(path.find_last_of("/\\") + 1).c_str(),
+                   w.name, sum.median, sum.p10, sum.p90, w.unit);
+            results.push_back({{"rom", path},
+                               {"workload", w.name},
+                               {"unit", w.unit},
+                               {"median", sum.median},
+                               {"p10", sum.p10},
+                               {"p90", sum.p90},
+                               {"min", sum.min},
+                               {"max", sum.max}});
+        }
+        return true;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    unsigned samples = 15;
+    unsigned warmup = 3;
+    bool jit = false;
+    std::string jsonPath;
+    std::vector<std::string> roms;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc)
+            samples = std::max(1ul, strtoul(argv[++i], nullptr, 10));
+        else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc)
+            warmup = strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--jit") == 0)
+            jit = true;
+        else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+            jsonPath = argv[++i];
+        else if (argv[i][0] == '-')
+        {
+            std::cerr << "usage: nes_bench [--samples N] [--warmup N] [--jit] [--json out.json] [rom.nes...]\n";
+            return 2;
+        }
+        else
+            roms.push_back(argv[i]);
+    }
+    if (roms.empty())
+        roms.push_back(std::string(SIMPLENES_SOURCE_DIR) + "/nestest.nes");
+
+    json report;
+    report["git_rev"] = gitRevision();
+#ifdef __OPTIMIZE__
+    report["optimized"] = true;
+#else
+    report["optimized"] = false;
+#endif
+    report["accurate_bus"] = CPU6502::Accuracy::cycleAccurate;
+    report["jit"] = jit;
+    report["convert_kernel"] = convertKernelName(bestConvertKernel());
+    report["samples"] = samples;
+    report["warmup"] = warmup;
+    report["results"] = json::array();
+
+    printf("%-24s %-14s %14s %14s %14s\n", "rom", "workload", "median", "p10", "p90");
+    int failed = 0;
+    for (const auto &rom : roms)
+        failed += !benchROM(rom, samples, warmup, jit, report["results"]);
+
+    if (!jsonPath.empty())
+    {
+        std::ofstream out(jsonPath);
+        out << report.dump(2) << '\n';
+        if (!out)
+        {
+            std::cerr << "nes_bench: cannot write " << jsonPath << "\n";
+            return 1;
+        }
+    }
+    return failed ? 1 : 0;
+}
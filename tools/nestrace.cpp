@@ -0,0 +1,56 @@
+// Renders a binary CPU trace (TraceBuffer file) as a nestest-style text log.
+//
+//   nestrace [--ppu] [--last N] trace.bin [out.txt]
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "Trace.h"
+
+int main(int argc, char **argv)
+{
+    bool withPPU = false;
+    size_t lastN = 0;
+    std::vector<std::string> files;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--ppu") == 0)
+            withPPU = true;
+        else if (strcmp(argv[i], "--last") == 0 && i + 1 < argc)
+            lastN = strtoull(argv[++i], nullptr, 10);
+        else
+            files.push_back(argv[i]);
+    }
+    if (files.empty() || files.size() > 2)
+    {
+        std::cerr << "usage: nestrace [--ppu] [--last N] trace.bin [out.txt]\n";
+        return 2;
+    }
+
+    std::vector<TraceRecord> records;
+    if (!TraceBuffer::readFile(files[0], records))
+    {
+        std::cerr << "nestrace: " << files[0] << " is not a trace file\n";
+        return 1;
+    }
+
+    std::ofstream file;
+    if (files.size() == 2)
+    {
+        file.open(files[1]);
+        if (!file)
+        {
+            std::cerr << "nestrace: cannot write " << files[1] << "\n";
+            return 1;
+        }
+    }
+    std::ostream &out = file.is_open() ? file : std::cout;
+
+    size_t first = (lastN && lastN < records.size()) ? records.size() - lastN : 0;
+    for (size_t i = first; i < records.size(); i++)
+        out << TraceBuffer::format(records[i], withPPU) << '\n';
+    return 0;
+}
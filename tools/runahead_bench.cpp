@@ -0,0 +1,148 @@
+// Measures how far each ROM can run ahead (see RunAhead.h) and still keep up
+// with the NTSC frame rate on one core.
+//
+//   runahead_bench [--frames F] [--max N] [--jit] rom.nes...
+//
+// For every N from 0 to --max (default 6), in both roll-back and
+// second-instance mode, runs F host frames (default 600) from the same point
+// and reports the mean and 99th percentile host frame time. The achievable N
+// is the largest whose 99th percentile fits in one NTSC frame. Nothing is
+// pressed, so this times whatever the game does on its own. A ROM whose
+// save or load takes SNAPSHOT_TARGET_US or more counts as a failure: run-ahead
+// does one of each per host frame and leans on them being cheap.
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include "Bus.h"
+#include "RunAhead.h"
+
+namespace
+{
+    constexpr double FRAME_BUDGET_MS = 1000.0 / 60.0988; // NTSC
+    constexpr unsigned WARMUP_FRAMES = 120;
+    constexpr double SNAPSHOT_TARGET_US = 10.0;
+
+    struct Timing
+    {
+        double meanMs;
+        double p99Ms;
+    };
+
+    Timing timeFrames(Bus &bus, RunAhead &runAhead, const std::vector<uint8_t> &start, unsigned frames)
+    {
+        bus.loadState(start);
+        std::vector<double> ms(frames);
+        double total = 0;
+        for (unsigned f = 0; f < frames; f++)
+        {
+            auto t0 = std::chrono::steady_clock::now();
+            runAhead.runFrame(bus);
+            ms[f] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+            total += ms[f];
+        }
+        std::sort(ms.begin(), ms.end());
+        return {total / frames, ms[std::min<size_t>(frames - 1, frames * 99 / 100)]};
+    }
+
+    bool benchROM(const std::string &path, unsigned frames, unsigned maxAhead, bool jit)
+    {
+        auto cart = std::make_shared<Cartridge>(path);
+        if (!cart->isImageValid())
+        {
+            std::cerr << "runahead_bench: cannot load " << path << "\n";
+            return false;
+        }
+        auto bus = std::make_unique<Bus>();
+        bus->insertCartridge(cart);
+        bus->cpu.connectBus(bus.get());
+        bus->cpu.reset();
+        bus->ppu.connectCartridge(cart);
+        bus->cpu.useRecompiler = jit;
+        for (unsigned f = 0; f < WARMUP_FRAMES; f++)
+        {
+            bus->runFrame();
+            bus->ppu.frame_complete = false;
+        }
+        std::vector<uint8_t> start;
+        bus->saveState(start);
+
+        // Snapshot cost on its own
+        std::vector<uint8_t> scratch;
+        const int reps = 10000;
+        auto t0 = std::chrono::steady_clock::now();
+        for (int i = 0; i < reps; i++)
+            bus->saveState(scratch);
+        auto t1 = std::chrono::steady_clock::now();
+        for (int i = 0; i < reps; i++)
+            bus->loadState(scratch);
+        auto t2 = std::chrono::steady_clock::now();
+        double saveUs = std::chrono::duration<double, std::micro>(t1 - t0).count() / reps;
+        double loadUs = std::chrono::duration<double, std::micro>(t2 - t1).count() / reps;
+        printf("%s: state %zu bytes, save %.2f us, load %.2f us\n", path.c_str(), start.size(), saveUs, loadUs);
+        if (saveUs >= SNAPSHOT_TARGET_US || loadUs >= SNAPSHOT_TARGET_US)
+        {
+            std::cerr << "runahead_bench: " << path << ": save/load over the " << SNAPSHOT_TARGET_US
+                      << " us target\n";
+            return false;
+        }
+
+        unsigned best[2] = {0, 0};
+        const char *modes[2] = {"rollback", "instance"};
+        printf("  %-9s %3s %10s %10s\n", "mode", "N", "mean ms", "p99 ms");
+        for (int mode = 0; mode < 2; mode++)
+        {
+            RunAhead runAhead;
+            if (mode == 1 && !runAhead.enableSecondInstance(cart->rom))
+                return false;
+            bool fits = true;
+            for (unsigned n = 0; n <= maxAhead; n++)
+            {
+                runAhead.frames = n;
+                Timing t = timeFrames(*bus, runAhead, start, frames);
+                printf("  %-9s %3u %10.3f %10.3f\n", modes[mode], n, t.meanMs, t.p99Ms);
+                fits = fits && t.p99Ms <= FRAME_BUDGET_MS;
+                if (fits)
+                    best[mode] = n;
+            }
+        }
+        printf("  achievable N at 60 fps: %u (rollback), %u (second instance)%s\n", best[0], best[1],
+               best[0] == maxAhead || best[1] == maxAhead ? "; raise --max to probe further" : "");
+        return true;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    unsigned frames = 600;
+    unsigned maxAhead = 6;
+    bool jit = false;
+    std::vector<std::string> roms;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            frames = std::max(1ul, strtoul(argv[++i], nullptr, 10));
+        else if (strcmp(argv[i], "--max") == 0 && i + 1 < argc)
+            maxAhead = strtoul(argv[++i], nullptr, 10);
+        else if (strcmp(argv[i], "--jit") == 0)
+            jit = true;
+        else
+            roms.push_back(argv[i]);
+    }
+    if (roms.empty())
+    {
+        std::cerr << "usage: runahead_bench [--frames F] [--max N] [--jit] rom.nes...\n";
+        return 2;
+    }
+
+    int failed = 0;
+    for (const auto &rom : roms)
+        failed += !benchROM(rom, frames, maxAhead, jit);
+    return failed ? 1 : 0;
+}
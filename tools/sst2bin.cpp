@@ -0,0 +1,107 @@
+// Converts SingleStepTests JSON files (v1/XX.json) into the fixed-layout
+// binary corpus described in SSTCorpus.h, for CPUsst --bin.
+//
+//   sst2bin [testdir=v1] [out=sst.bin]
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "json.hpp"
+#include "SSTCorpus.h"
+
+using json = nlohmann::json;
+
+static sst::Regs readRegs(const json &state)
+{
+    sst::Regs r = {};
+    r.pc = state["pc"];
+    r.a = state["a"];
+    r.x = state["x"];
+    r.y = state["y"];
+    r.s = state["s"];
+    r.p = state["p"];
+    return r;
+}
+
+static uint8_t appendCells(const json &ram, std::vector<sst::Cell> &cells)
+{
+    for (auto &entry : ram)
+    {
+        sst::Cell c = {};
+        c.addr = entry[0];
+        c.value = entry[1];
+        cells.push_back(c);
+    }
+    return static_cast<uint8_t>(ram.size());
+}
+
+int main(int argc, char **argv)
+{
+    std::string dir = argc > 1 ? argv[1] : "v1";
+    std::string outPath = argc > 2 ? argv[2] : "sst.bin";
+
+    sst::Header header = {};
+    memcpy(header.magic, sst::MAGIC, sizeof(sst::MAGIC));
+    header.version = sst::VERSION;
+    std::vector<sst::Case> cases;
+    std::vector<sst::Cell> cells;
+
+    for (int opcode = 0; opcode <= 0xFF; opcode++)
+    {
+        header.opcodeStart[opcode] = static_cast<uint32_t>(cases.size());
+
+        std::stringstream filename;
+        filename << dir << "/"
+                 << std::uppercase << std::hex << std::setw(2) << std::setfill('0')
+                 << opcode << ".json";
+        std::ifstream f(filename.str());
+        if (!f.is_open())
+            continue;
+
+        json tests;
+        f >> tests;
+        for (auto &t : tests)
+        {
+            const json &initial = t["initial"];
+            const json &final = t["final"];
+            if (initial["ram"].size() > 0xFF || final["ram"].size() > 0xFF || t["cycles"].size() > 0xFF)
+            {
+                std::cerr << "sst2bin: " << t["name"].get<std::string>() << " does not fit the corpus layout\n";
+                return 1;
+            }
+
+            sst::Case c = {};
+            c.initial = readRegs(initial);
+            c.final = readRegs(final);
+            c.firstCell = static_cast<uint32_t>(cells.size());
+            c.initialCells = appendCells(initial["ram"], cells);
+            c.finalCells = appendCells(final["ram"], cells);
+            c.cycles = static_cast<uint8_t>(t["cycles"].size());
+            cases.push_back(c);
+        }
+    }
+    header.opcodeStart[256] = static_cast<uint32_t>(cases.size());
+    header.caseCount = static_cast<uint32_t>(cases.size());
+    header.cellCount = static_cast<uint32_t>(cells.size());
+
+    if (cases.empty())
+    {
+        std::cerr << "sst2bin: no tests found in " << dir << "\n";
+        return 1;
+    }
+
+    std::ofstream out(outPath, std::ios::binary);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(cases.data()), cases.size() * sizeof(sst::Case));
+    out.write(reinterpret_cast<const char *>(cells.data()), cells.size() * sizeof(sst::Cell));
+    if (!out)
+    {
+        std::cerr << "sst2bin: cannot write " << outPath << "\n";
+        return 1;
+    }
+
+    std::cout << "Wrote " << cases.size() << " tests, " << cells.size() << " RAM cells to " << outPath << "\n";
+    return 0;
+}